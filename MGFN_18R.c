@@ -178,6 +178,7 @@ void save_to_file(
 }
 
 void generate_random_data(uint64_t* data) {
+#ifdef _WIN32
     unsigned int r1 = 0, r2 = 0;
     if (rand_s(&r1) || rand_s(&r2)) {
         *data = 0ULL; /* fallback */
@@ -185,6 +186,50 @@ void generate_random_data(uint64_t* data) {
     else {
         *data = ((uint64_t)r1 << 32) | r2;
     }
+#else
+    FILE* f = fopen("/dev/urandom", "rb");
+    if (!f || fread(data, sizeof(*data), 1, f) != 1)
+        *data = 0ULL; /* fallback */
+    if (f)
+        fclose(f);
+#endif
+}
+
+static inline uint32_t mulhilo32(uint32_t a, uint32_t b, uint32_t* hi) {
+    uint64_t p = (uint64_t)a * b;
+    *hi = (uint32_t)(p >> 32);
+    return (uint32_t)p;
+}
+
+void philox4x32_10(
+    const uint32_t ctr[4],
+    const uint32_t key[2],
+    uint32_t out[4]
+) {
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int r = 0; r < 10; ++r) {
+        uint32_t hi0, hi1;
+        uint32_t lo0 = mulhilo32(0xD2511F53U, c0, &hi0);
+        uint32_t lo1 = mulhilo32(0xCD9E8D57U, c2, &hi1);
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += 0x9E3779B9U;   /* Weyl key bump */
+        k1 += 0xBB67AE85U;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+uint64_t generate_plaintext(uint64_t seed, uint64_t index) {
+    const uint32_t ctr[4] = { (uint32_t)index, (uint32_t)(index >> 32), 0, 0 };
+    const uint32_t key[2] = { (uint32_t)seed, (uint32_t)(seed >> 32) };
+    uint32_t out[4];
+
+    philox4x32_10(ctr, key, out);
+    return ((uint64_t)out[1] << 32) | out[0];
 }
 
 uint32_t array_to_int(uint8_t* bit_list) {
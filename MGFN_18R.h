@@ -85,6 +85,15 @@ extern "C" {
         uint64_t input
     );
 
+    /* Inlinable 32‑bit twin of Table_lookup() for hot loops in other TUs */
+    static inline uint32_t table_lookup32(uint32_t x)
+    {
+        return te1[(((x >> 16) & 0x7) << 5) | ((x >> 27) & 0x1F)]
+            ^ te2[(x >> 19) & 0xFF]
+            ^ te3[x & 0xFF]
+            ^ te4[(x >> 8) & 0xFF];
+    }
+
     uint64_t encrypt_single_round(
         uint64_t P,
         uint64_t key
@@ -110,6 +119,23 @@ extern "C" {
         uint64_t* data
     );
 
+    /* Philox4x32‑10 counter‑based generator (Salmon et al., SC'11) */
+    void philox4x32_10(
+        const uint32_t ctr[4],
+        const uint32_t key[2],
+        uint32_t out[4]
+    );
+
+    /*
+     * Plaintext number `index` of the stream keyed by `seed`.  A pure function
+     * of (seed, index): threads can fill disjoint index ranges with no shared
+     * state, and any pair can be regenerated on demand.
+     */
+    uint64_t generate_plaintext(
+        uint64_t seed,
+        uint64_t index
+    );
+
     uint32_t array_to_int(
         uint8_t* bit_list
     );
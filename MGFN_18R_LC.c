@@ -5,20 +5,41 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include <time.h>
 #include <omp.h>
 
 #include "MGFN_18R.h"          /* Encryption & key‑schedule API */
+#include "MGFN_18R_bitslice.h" /* 64‑way bitsliced encryption for dataset generation */
+#include "MGFN_18R_batch.h"    /* SIMD batch decrypt_half_* for attack rounds 1–2 */
+#include "dataset_io.h"        /* Positional (lock‑free) dataset writes */
+#include "dataset_source.h"    /* File‑backed or regenerate‑on‑demand (P,C) pairs */
 #include "recover_masterkey.h" /* Master‑key recovery (RK16 xor K10_R,RK17 xor K10_L,RK18 xor K10_R + 2 pairs ⇒ 128‑bit) */
+#include "key_enum.h"          /* Likelihood‑ordered enumeration of ranked nibbles */
+#include "fwht.h"              /* Walsh–Hadamard correlations of joint key guesses */
 
 /* -------------------------------------------------------------------------- */
 /*  Macros & constants                                                        */
 /* -------------------------------------------------------------------------- */
 #define TARGET_PAIRS  ((uint64_t)1ULL << 33)   /* 2^33 (P,C) pairs                    */
 #define BUFFER_PAIRS  4096                     /* I/O buffer                          */
-#define TOTAL_KEYS    1                        /* Number of random keys for demo      */
+#define TOTAL_KEYS    1                        /* Random keys per data size (--experiment) */
 #define MAX_THREADS   32                       /* OpenMP threads                      */
 #define MAX_KEYS      16                       /* Nibble (4‑bit) candidates           */
+#define DATASET_SEED  0x4D47464E31385221ULL    /* Plaintext stream seed ("MGFN18R!")  */
+#define PLANE_CHUNK   1024                     /* Plane words (64 pairs each) per read */
+#define STRIPE_PAIRS  (1 << 16)                /* Pairs per stripe of a striped dataset */
+#define DCOL_MEM_MAX  (1ULL << 32)             /* Largest d1 / d2 column kept in memory */
+#define KEY_BUDGET    8                        /* Round‑key combinations searched by default */
+#define MAX_DATA_SHIFT 4                       /* --data-shift: at most 16x less data */
+#define STOP_CHECK    (1 << 24)                /* Pairs between early‑stopping tests  */
+#define CKPT_MAGIC    0x54504B43u              /* "CKPT"                              */
+#define CKPT_VERSION  2
+#define CKPT_SECONDS  60.0                     /* Least time between in‑pass checkpoints */
+#define EXP_SEED      0x4D47464E45585021ULL    /* Master keys of --experiment ("MGFNEXP!") */
+#define EXP_SHIFTS    "4,6,8"                  /* Default --exp-shifts                 */
+#define EXP_MAX_SHIFT 20                       /* Least data: 2^(stage_exp − 20) pairs */
+#define EXP_RANK_MAX  4096                     /* Combinations searched for the true key */
 
 /* Map stage number to key index position */
 static inline int stage_to_pos(int stage)
@@ -34,6 +55,106 @@ static const int stage_exp[3][8] = {
     {27, 29, 29, 27, 29, 29, 29, 29}  /* round 2 */
 };
 
+/* Pairs a stage counts with its data cut by 2^shift */
+static inline uint64_t stage_need(int round, int stage, int shift)
+{
+    return 1ULL << (stage_exp[round][stage] - shift);
+}
+
+/*
+ * S‑box terms of every stage.  The same eight approximations are used in all
+ * three rounds, on the nibbles of V = C (round 0), d1 (round 1) or d2
+ * (round 2): each term is (S[x ^ k] >> bit) & 1 for a nibble x of V and
+ * either an already recovered nibble k = right_keys[round][pos] or the
+ * current key guess.  Together with stage_linear[round][stage] below this
+ * is the whole approximation: stage_kernel() compiles the pair into the
+ * counting kernel, so adding an approximation is adding table rows.
+ */
+#define NIB_ROT    (-1)   /* rotated V: V31, V16, V17, V18 as bits 0..3 */
+#define NIB_MIXED  (-2)   /* stage_pos_nibble(): terms on different nibbles */
+#define KEY_GUESS  (-1)
+
+typedef struct {
+    int8_t  nib;          /* V bit of the nibble's LSB, or NIB_ROT  */
+    int8_t  pos;          /* right_keys[round] index, or KEY_GUESS  */
+    uint8_t bit;          /* S‑box output bit                       */
+} SboxTerm;
+
+typedef struct {
+    int      nterms;
+    SboxTerm term[5];     /* the last term carries the key guess    */
+} StageTerms;
+
+static const StageTerms stage_terms[8] = {
+    { 1, { { NIB_ROT, KEY_GUESS, 0 } } },
+    { 1, { { 8, KEY_GUESS, 2 } } },
+    { 2, { { 8, 1, 2 }, { 19, KEY_GUESS, 0 } } },
+    { 2, { { 19, 5, 0 }, { 27, KEY_GUESS, 0 } } },
+    { 3, { { NIB_ROT, 8, 0 }, { 8, 1, 1 }, { 4, KEY_GUESS, 1 } } },
+    { 3, { { NIB_ROT, 8, 0 }, { 8, 1, 1 }, { 23, KEY_GUESS, 0 } } },
+    { 5, { { NIB_ROT, 8, 0 }, { NIB_ROT, 8, 3 }, { 19, 5, 3 }, { 4, 4, 2 }, { 12, KEY_GUESS, 1 } } },
+    { 4, { { NIB_ROT, 8, 0 }, { 19, 5, 3 }, { 12, 2, 1 }, { 0, KEY_GUESS, 3 } } },
+};
+
+/*
+ * Linear part of every approximation: the P, C, d1 and d2 bits XORed into
+ *   t = (XOR of P bits) ^ (XOR of C bits) ^ (XOR of d1 / d2 bits) ^ (S‑box terms).
+ * Round 0 uses only P and C, which is what lets it run on bit planes.
+ */
+typedef struct {
+    uint64_t  p_bits;     /* P bits XORed into t                    */
+    uint64_t  c_bits;     /* C bits XORed into t                    */
+    uint32_t  d1_bits;    /* d1 bits (rounds 1 and 2)               */
+    uint32_t  d2_bits;    /* d2 bits (round 2)                      */
+} StageLinear;
+
+#define BIT(n)  (1ULL << (n))
+static const StageLinear stage_linear[3][8] = {
+    {   /* round 0 */
+        { BIT(48), BIT(48) | BIT(16), 0, 0 },
+        { BIT(48), BIT(16) | BIT(50), 0, 0 },
+        { BIT(48), BIT(16) | BIT(50) | BIT(63), 0, 0 },
+        { BIT(48), BIT(16) | BIT(49) | BIT(63), 0, 0 },
+        { BIT(16), BIT(18) | BIT(40) | BIT(43) | BIT(48), 0, 0 },
+        { BIT(16), BIT(18) | BIT(41) | BIT(43) | BIT(48), 0, 0 },
+        { BIT(16), BIT(17) | BIT(31) | BIT(48) | BIT(51) | BIT(53) | BIT(59) | BIT(61), 0, 0 },
+        { BIT(16), BIT(17) | BIT(31) | BIT(48) | BIT(51) | BIT(53) | BIT(60), 0, 0 },
+    },
+    {   /* round 1 */
+        { BIT(16), BIT(16), BIT(16), 0 },
+        { BIT(16), BIT(18), BIT(16), 0 },
+        { BIT(16), BIT(18) | BIT(31), BIT(16), 0 },
+        { BIT(16), BIT(17) | BIT(31), BIT(16), 0 },
+        { BIT(48) | BIT(16), BIT(8) | BIT(11) | BIT(16), BIT(18), 0 },
+        { BIT(48) | BIT(16), BIT(9) | BIT(11) | BIT(16), BIT(18), 0 },
+        { BIT(48) | BIT(16), BIT(16) | BIT(19) | BIT(21) | BIT(27) | BIT(29), BIT(17) | BIT(31), 0 },
+        { BIT(48) | BIT(16), BIT(16) | BIT(19) | BIT(21) | BIT(28), BIT(17) | BIT(31), 0 },
+    },
+    {   /* round 2 */
+        { BIT(48) | BIT(16), 0, BIT(16), BIT(16) },
+        { BIT(48) | BIT(16), 0, BIT(18), BIT(16) },
+        { BIT(48) | BIT(16), 0, BIT(18) | BIT(31), BIT(16) },
+        { BIT(48) | BIT(16), 0, BIT(17) | BIT(31), BIT(16) },
+        { BIT(48), 0, BIT(8) | BIT(11) | BIT(16), BIT(18) },
+        { BIT(48), 0, BIT(9) | BIT(11) | BIT(16), BIT(18) },
+        { BIT(48), 0, BIT(16) | BIT(19) | BIT(21) | BIT(27) | BIT(29), BIT(17) | BIT(31) },
+        { BIT(48), 0, BIT(16) | BIT(19) | BIT(21) | BIT(28), BIT(17) | BIT(31) },
+    },
+};
+#undef BIT
+
+/* S‑box output bit of the guessed term */
+static inline int stage_guess_bit(int stage)
+{
+    return stage_terms[stage].term[stage_terms[stage].nterms - 1].bit;
+}
+
+/*
+ * Set by the experiment harness before its attacks start: concurrent runs
+ * print nothing per stage (tables, progress, picks), only their summaries.
+ */
+static int g_quiet = 0;
+
 /* -------------------------------------------------------------------------- */
 /*  Select the key index with the largest deviation in statistics             */
 /* -------------------------------------------------------------------------- */
@@ -42,402 +163,1603 @@ static int find_max_deviation_index(const uint64_t* bucket, uint64_t used)
     uint64_t half = used >> 1, max_diff = 0;
     int best = -1;
 
-    puts("Idx\tValue\t\tDiff");
-    puts("---\t-------------\t-------------");
+    if (!g_quiet) {
+        puts("Idx\tValue\t\tDiff");
+        puts("---\t-------------\t-------------");
+    }
 
     for (int i = 0; i < MAX_KEYS; ++i) {
         uint64_t diff = (bucket[i] > half) ? bucket[i] - half : half - bucket[i];
-        printf("%3d\t%llu\t%llu\n", i,
-            (unsigned long long)bucket[i],
-            (unsigned long long)diff);
+        if (!g_quiet)
+            printf("%3d\t%llu\t%llu\n", i,
+                (unsigned long long)bucket[i],
+                (unsigned long long)diff);
         if (diff > max_diff) {
             max_diff = diff;
             best = i;
         }
     }
-    printf("\nMax deviation at index %d (diff = %llu)\n\n",
-        best, (unsigned long long)max_diff);
+    if (!g_quiet)
+        printf("\nMax deviation at index %d (diff = %llu)\n\n",
+            best, (unsigned long long)max_diff);
     return best;
 }
 
+/*
+ * Log‑likelihood of each guess of a lone stage: deviation d over N pairs
+ * scores 2·d²/N, the log‑likelihood ratio of a correlation 2d/N against
+ * none.  The largest score is find_max_deviation_index()'s pick.
+ */
+static void stage_scores(const uint64_t bucket[MAX_KEYS], uint64_t used, double score[MAX_KEYS])
+{
+    for (int k = 0; k < MAX_KEYS; ++k) {
+        double d = (double)bucket[k] - 0.5 * (double)used;
+        score[k] = used ? 2.0 * d * d / (double)used : 0.0;
+    }
+}
+
+/*
+ * Sequential test for early stopping on the guess scores the stage is
+ * decided by (stage_scores(), or max‑marginals in a pass): the leading
+ * guess is settled once it beats the runner‑up by z².  Against a runner‑up
+ * at noise level that is a deviation of z standard deviations of a bucket
+ * difference, sqrt(N/2).  z <= 0 never settles.
+ */
+static int stage_settled(const double score[MAX_KEYS], double z, int* best)
+{
+    double s1 = score[0], s2 = -1.0;
+
+    *best = 0;
+    for (int i = 1; i < MAX_KEYS; ++i) {
+        if (score[i] > s1) {
+            s2 = s1;
+            s1 = score[i];
+            *best = i;
+        }
+        else if (score[i] > s2) {
+            s2 = score[i];
+        }
+    }
+    return z > 0 && s1 - s2 > z * z;
+}
+
 /* -------------------------------------------------------------------------- */
 /*  (P,C) generation + progress display                                       */
 /* -------------------------------------------------------------------------- */
-static void generate_dataset(const KeySchedule* ks,
+
+/* Per‑thread progress counter, padded to its own cache line */
+typedef struct {
+    uint64_t done;
+    uint8_t  pad[56];
+} ThreadCounter;
+
+/*
+ * Materialises `oracle` into `path` in `format`: the file then serves the same
+ * pairs.  Packed and plane datasets store whole 64‑pair groups, so the oracle
+ * is extended to the next multiple of 64 (the extra pairs are just further
+ * stream indices).
+ *
+ * With `stripes` (count > 0) the records go round‑robin into the member
+ * files instead, STRIPE_PAIRS per stripe.
+ *
+ * A dataset left by an earlier run with the same format, seed, key and
+ * stripe layout is reused as is when it is large enough, and otherwise only
+ * extended by the missing pairs; anything else is regenerated from scratch.
+ */
+static void generate_dataset(DataSource* oracle,
     const char* path,
-    uint64_t pairs)
+    int format,
+    const DataStripes* stripes)
 {
-    FILE* fp = fopen(path, "wb");
-    if (!fp) {
-        perror("open dataset");
+    uint64_t pairs = oracle->pairs = data_format_round(format, oracle->pairs);
+    uint64_t start = 0;
+
+    DataHeader want, have;
+    DataStripes old;
+    data_header_init(&want, format, pairs, oracle->seed, oracle->key_fp);
+    want.stripes = (uint32_t)stripes->count;
+    want.stripe_pairs = stripes->count ? stripes->pairs : 0;
+    if (data_header_read(path, &have) && data_header_compatible(&have, &want)
+        && data_stripes_read(path, &have, &old) && data_stripes_equal(&old, stripes)) {
+        if (have.pairs >= pairs) {
+            printf("[DATA] reusing %s (%s, %llu pairs)\n", path,
+                data_format_name(format), (unsigned long long)have.pairs);
+            return;
+        }
+        start = have.pairs;
+        printf("[DATA] extending %s from %llu to %llu pairs\n", path,
+            (unsigned long long)start, (unsigned long long)pairs);
+    }
+
+    /* Pre‑sized: chunk c always lands at data_format_bytes(start + c · BUFFER_PAIRS) */
+    DataSink sink;
+    if (!data_sink_open(&sink, path, &want, start, stripes)) {
+        perror("create dataset");
         return;
     }
 
-    uint64_t global_cnt = 0;
-    double t0 = omp_get_wtime();
+    uint64_t todo = pairs - start;
+    int64_t chunks = (int64_t)((todo + BUFFER_PAIRS - 1) / BUFFER_PAIRS);
+    ThreadCounter progress[MAX_THREADS];
+    memset(progress, 0, sizeof(progress));
+    int failed = 0;
+    double t0 = omp_get_wtime(), last = t0;
 
 #pragma omp parallel num_threads(MAX_THREADS)
     {
-        uint64_t buf[BUFFER_PAIRS][2];
-        size_t cnt = 0;
-        int64_t idx = 0;
-#pragma omp for schedule(static)
-        for (idx = 0; idx < pairs; ++idx) {
-            uint64_t pt, ct;
-            generate_random_data(&pt);
-            encrypt(pt, (KeySchedule*)ks, &ct);
-
-            buf[cnt][0] = pt;
-            buf[cnt][1] = ct;
-            ++cnt;
-
-            if (cnt == BUFFER_PAIRS) {
-#pragma omp critical
-                fwrite(buf, sizeof(buf[0]), BUFFER_PAIRS, fp);
-                cnt = 0;
+        Pair buf[BUFFER_PAIRS];
+        int tid = omp_get_thread_num();
+        int64_t c = 0;
+#pragma omp for schedule(dynamic, 16)
+        for (c = 0; c < chunks; ++c) {
+            uint64_t first = start + (uint64_t)c * BUFFER_PAIRS;
+            size_t n = (pairs - first < BUFFER_PAIRS) ? (size_t)(pairs - first) : BUFFER_PAIRS;
+
+            /* pair k depends only on (seed, k): the file is identical for any thread count */
+            data_source_read(oracle, first, n, buf);
+
+            if (!data_sink_write(&sink, first, n, buf)) {
+#pragma omp critical(data_failed)
+                failed = 1;
             }
 
 #pragma omp atomic
-            ++global_cnt;
+            progress[tid].done += n;
 
-            if (omp_get_thread_num() == 0 && (global_cnt & 0xFFFF) == 0) {
-                double prog = (double)global_cnt / pairs;
+            if (tid == 0 && omp_get_wtime() - last > 0.5) {
+                uint64_t total = 0;
+#pragma omp flush(progress)
+                for (int t = 0; t < MAX_THREADS; ++t)
+                    total += progress[t].done;
+                last = omp_get_wtime();
+
+                double prog = (double)total / todo;
                 double pct = ((int)(prog * 1000)) / 10.0;
-                double eta = prog ? (omp_get_wtime() - t0) * (1.0 / prog - 1.0) : 0.0;
+                double eta = prog ? (last - t0) * (1.0 / prog - 1.0) : 0.0;
 
                 printf("\r[DATA] %.1f%% | %llu/%llu | ETA %.2fs ",
-                    pct, (unsigned long long)global_cnt, (unsigned long long)pairs, eta);
+                    pct, (unsigned long long)(start + total), (unsigned long long)pairs, eta);
                 fflush(stdout);
             }
         }
-
-        /* Flush remaining data */
-#pragma omp critical
-        if (cnt)
-            fwrite(buf, sizeof(buf[0]), cnt, fp);
     }
     puts("");
-    fclose(fp);
+    /* the header only claims the new pairs once every chunk is on disk */
+    if (failed || !data_sink_commit(&sink))
+        perror("write dataset");
+    data_sink_close(&sink);
+}
+
+/*
+ * Multi‑key generate_dataset(): one dataset per key schedule, paths[k] for
+ * ks[k], all over the plaintext stream `seed`, written in a single pass.
+ * Every plaintext is generated once and encrypted under 64 keys per call
+ * with the keys in the bitsliced lanes (bs_encrypt_keys), and each key's
+ * ciphertexts go to its own buffer and sink, so the files are exactly what
+ * generate_dataset() writes for that key.  A complete dataset from an
+ * earlier run is reused; any other is rewritten from scratch (unstriped).
+ * Returns 1 if every dataset is in place.
+ */
+static int generate_datasets(const KeySchedule* ks,
+    int nkeys,
+    uint64_t seed,
+    uint64_t pairs,
+    const char* const* paths,
+    int format)
+{
+    DataStripes none = { 0 };
+    DataSink* sink = calloc((size_t)nkeys, sizeof(DataSink));
+    int* key = calloc((size_t)nkeys, sizeof(int));
+    int nw = 0, failed = 0;
+
+    pairs = data_format_round(format, pairs);
+    for (int k = 0; k < nkeys && sink && key; ++k) {
+        DataHeader want, have;
+        data_header_init(&want, format, pairs, seed, data_key_fingerprint(&ks[k]));
+        if (data_header_read(paths[k], &have) && data_header_compatible(&have, &want)
+            && !have.stripes && have.pairs >= pairs) {
+            printf("[DATA] reusing %s (%s, %llu pairs)\n", paths[k],
+                data_format_name(format), (unsigned long long)have.pairs);
+            continue;
+        }
+        if (!data_sink_open(&sink[nw], paths[k], &want, 0, &none)) {
+            perror(paths[k]);
+            failed = 1;
+            break;
+        }
+        key[nw++] = k;
+    }
+
+    /* Groups of 64 keys in the lanes; a short last group repeats its last key */
+    int groups = (nw + BS_LANES - 1) / BS_LANES;
+    BitslicedKeySchedule* bks = groups ? malloc(sizeof(BitslicedKeySchedule) * (size_t)groups) : NULL;
+    if (!sink || !key || (groups && !bks))
+        failed = 1;
+    for (int g = 0; g < groups && !failed; ++g) {
+        KeySchedule lane[BS_LANES];
+        for (int l = 0; l < BS_LANES; ++l) {
+            int w = g * BS_LANES + l < nw ? g * BS_LANES + l : nw - 1;
+            lane[l] = ks[key[w]];
+        }
+        bs_key_schedule_lanes(lane, &bks[g]);
+    }
+
+    int64_t chunks = (failed || !nw) ? 0 : (int64_t)((pairs + BUFFER_PAIRS - 1) / BUFFER_PAIRS);
+    ThreadCounter progress[MAX_THREADS];
+    memset(progress, 0, sizeof(progress));
+    double t0 = omp_get_wtime(), last = t0;
+
+#pragma omp parallel num_threads(MAX_THREADS) if (chunks > 1)
+    {
+        /* buf[w · BUFFER_PAIRS + i]: pair i of the chunk under key w */
+        Pair* buf = chunks ? malloc(sizeof(Pair) * BUFFER_PAIRS * (size_t)nw) : NULL;
+        int tid = omp_get_thread_num();
+        int64_t c = 0;
+        if (chunks && !buf) {
+#pragma omp critical(data_failed)
+            failed = 1;
+        }
+#pragma omp for schedule(dynamic, 4)
+        for (c = 0; c < chunks; ++c) {
+            uint64_t first = (uint64_t)c * BUFFER_PAIRS;
+            size_t n = (pairs - first < BUFFER_PAIRS) ? (size_t)(pairs - first) : BUFFER_PAIRS;
+            if (!buf)
+                continue;
+
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t pt = generate_plaintext(seed, first + i), ct[BS_LANES];
+                for (int g = 0; g < groups; ++g) {
+                    bs_encrypt_keys(pt, &bks[g], ct);
+                    for (int l = 0; l < BS_LANES && g * BS_LANES + l < nw; ++l) {
+                        Pair* p = &buf[(size_t)(g * BS_LANES + l) * BUFFER_PAIRS + i];
+                        p->plaintext = pt;
+                        p->ciphertext = ct[l];
+                    }
+                }
+            }
+            for (int w = 0; w < nw; ++w) {
+                if (!data_sink_write(&sink[w], first, n, buf + (size_t)w * BUFFER_PAIRS)) {
+#pragma omp critical(data_failed)
+                    failed = 1;
+                }
+            }
+
+#pragma omp atomic
+            progress[tid].done += n;
+
+            if (tid == 0 && omp_get_wtime() - last > 0.5) {
+                uint64_t total = 0;
+#pragma omp flush(progress)
+                for (int t = 0; t < MAX_THREADS; ++t)
+                    total += progress[t].done;
+                last = omp_get_wtime();
+
+                double prog = (double)total / pairs;
+                double eta = prog ? (last - t0) * (1.0 / prog - 1.0) : 0.0;
+                printf("\r[DATA] %d keys: %.1f%% | %llu/%llu | ETA %.2fs ", nw,
+                    ((int)(prog * 1000)) / 10.0, (unsigned long long)total, (unsigned long long)pairs, eta);
+                fflush(stdout);
+            }
+        }
+        free(buf);
+    }
+    if (chunks)
+        puts("");
+
+    /* the headers only claim the pairs once every chunk of every key is on disk */
+    for (int w = 0; w < nw; ++w) {
+        if (!failed && !data_sink_commit(&sink[w])) {
+            perror(paths[key[w]]);
+            failed = 1;
+        }
+        data_sink_close(&sink[w]);
+    }
+    free(bks);
+    free(key);
+    free(sink);
+    return !failed;
 }
 
 /* -------------------------------------------------------------------------- */
-/*  Linear Cryptanalysis                                                      */
+/*  Distillation scoring                                                      */
 /* -------------------------------------------------------------------------- */
-static void linear_attack_recover_keys(const char* dataset_path,
-    uint8_t rk_nib[3][9],
-    FILE* logfp)
+
+/*
+ * All 16 guesses at once: bit k of mask[x] is (S[x ^ k] >> bit) & 1, so a
+ * pair with parity p and active nibble x has t = p ^ bit k of mask[x] under
+ * every guess k — one lookup and one XOR instead of 16 evaluations.
+ */
+static void stage_key_masks(int bit, uint16_t mask[16])
 {
     extern uint8_t S[16];
+    for (int x = 0; x < 16; ++x) {
+        mask[x] = 0;
+        for (int k = 0; k < MAX_KEYS; ++k)
+            mask[x] |= (uint16_t)(((S[x ^ k] >> bit) & 1) << k);
+    }
+}
 
-    uint8_t right_keys[3][9] = { {0} };
+/*
+ * Scores all 16 guesses from a distillation table: dist[p][x] counts pairs
+ * with key‑independent parity p and active nibble x, and bucket[k] becomes
+ * the number of pairs with t = 1 under guess k.
+ */
+static void score_distilled(const uint64_t dist[2][16], int bit, uint64_t bucket[MAX_KEYS])
+{
+    uint16_t mask[16];
+    stage_key_masks(bit, mask);
+
+    for (int k = 0; k < MAX_KEYS; ++k)
+        bucket[k] = 0;
+    for (int x = 0; x < 16; ++x) {
+        for (int p = 0; p < 2; ++p) {
+            uint16_t t = (uint16_t)(p ? ~mask[x] : mask[x]);
+            for (int k = 0; k < MAX_KEYS; ++k)
+                if ((t >> k) & 1)
+                    bucket[k] += dist[p][x];
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Approximations split into key‑independent part and active nibble          */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * Every approximation has the form  t = p ^ ((S[x ^ key] >> bit) & 1)  with
+ * bit = stage_guess_bit(stage).  A StageKernel is one (round, stage) of the
+ * tables above compiled for the nibbles fixed so far: p is the parity of
+ * the masked P / C / d1 / d2 bits plus one 16‑bit S‑box mask per fixed
+ * nibble, x and y are plain shifts.  Nibbles are taken from
+ *   w = V | (rotated V) << 32
+ * so NIB_ROT is the nibble at bit 32 and a missing joint nibble (bit 40)
+ * reads 0.  The counting loop is instantiated per round and number of
+ * fixed slots, so it has no branches and no S‑box lookups.
+ */
+#define KERNEL_FIXED  4                        /* fixed‑key nibble slots per stage  */
+#define KERNEL_ROT    32                       /* w bit of the rotated nibble       */
+#define KERNEL_ZERO   40                       /* w bits that are always 0          */
+
+typedef struct {
+    uint64_t p_bits;
+    uint64_t c_bits;
+    uint64_t d_bits;                  /* d1 bits low, d2 bits high           */
+    uint16_t fixed[KERNEL_FIXED];     /* bit v: terms of the slot at nibble v */
+    uint8_t  fixed_sh[KERNEL_FIXED];
+    int      nfixed;
+    uint8_t  x_sh;                    /* active (guessed) nibble             */
+    uint8_t  y_sh;                    /* joint nibble, KERNEL_ZERO if none   */
+} StageKernel;
+
+/*
+ * Parity of x by folding; like bs_popcount64 it must not assume a popcount
+ * instruction, which the baseline x64 target does not guarantee.
+ */
+static inline int parity64(uint64_t x)
+{
+    x ^= x >> 32;
+    x ^= x >> 16;
+    x ^= x >> 8;
+    x ^= x >> 4;
+    return (0x6996 >> (x & 0xF)) & 1;
+}
+
+static inline int nibble_shift(int nib)
+{
+    return nib == NIB_ROT ? KERNEL_ROT : nib;
+}
+
+/*
+ * Kernel of `stage` in `round` with the fixed nibbles rk (= right_keys[round]);
+ * joint >= 0 also extracts the nibble joint_nib as y.
+ */
+static void stage_kernel(int round, int stage, const uint8_t rk[9], int joint, int joint_nib,
+    StageKernel* k)
+{
+    extern uint8_t S[16];
+    const StageLinear* lin = &stage_linear[round][stage];
+    const StageTerms* st = &stage_terms[stage];
+    int pos[KERNEL_FIXED];
+    int nf = 0;
+
+    memset(k, 0, sizeof(*k));
+    k->p_bits = lin->p_bits;
+    k->c_bits = lin->c_bits;
+    k->d_bits = lin->d1_bits | ((uint64_t)lin->d2_bits << 32);
+    for (int f = 0; f < KERNEL_FIXED; ++f)
+        k->fixed_sh[f] = KERNEL_ZERO;
+
+    for (int t = 0; t < st->nterms; ++t) {
+        const SboxTerm* term = &st->term[t];
+        int sh = nibble_shift(term->nib);
+        if (term->pos == KEY_GUESS) {
+            k->x_sh = (uint8_t)sh;
+            continue;
+        }
+        /* terms on the same nibble and key share a slot */
+        int f = 0;
+        while (f < nf && !(k->fixed_sh[f] == sh && pos[f] == term->pos))
+            ++f;
+        if (f == nf) {
+            k->fixed_sh[nf] = (uint8_t)sh;
+            pos[nf++] = term->pos;
+        }
+        for (int v = 0; v < 16; ++v)
+            k->fixed[f] ^= (uint16_t)(((S[v ^ rk[term->pos]] >> term->bit) & 1) << v);
+    }
+    k->nfixed = nf;
+    k->y_sh = (uint8_t)(joint >= 0 ? nibble_shift(joint_nib) : KERNEL_ZERO);
+}
+
+/*
+ * Adds m pairs to tab[p][y][x].  V is C (round 0), d1 or d2; `round` and
+ * `nf` are constants in every instance below.
+ */
+static inline void kernel_count(const StageKernel* k, int round, int nf,
+    const Pair* pairs, const uint32_t* d1, const uint32_t* d2, size_t m,
+    uint64_t tab[2][16][16])
+{
+    for (size_t i = 0; i < m; ++i) {
+        uint64_t C = pairs[i].ciphertext;
+        uint64_t d = round == 0 ? 0 : round == 1 ? d1[i] : (d1[i] | ((uint64_t)d2[i] << 32));
+        uint32_t v = round == 0 ? (uint32_t)C : round == 1 ? d1[i] : d2[i];
+        uint64_t w = v | ((uint64_t)(((v >> 15) & 0xE) ^ (v >> 31)) << KERNEL_ROT);
+        int t = parity64((pairs[i].plaintext & k->p_bits) ^ (C & k->c_bits) ^ (d & k->d_bits));
+
+        for (int f = 0; f < nf; ++f)
+            t ^= k->fixed[f] >> ((w >> k->fixed_sh[f]) & 0xF);
+        tab[t & 1][(w >> k->y_sh) & 0xF][(w >> k->x_sh) & 0xF]++;
+    }
+}
+
+typedef void (*KernelCountFn)(const StageKernel* k, const Pair* pairs,
+    const uint32_t* d1, const uint32_t* d2, size_t m, uint64_t tab[2][16][16]);
+
+#define KERNEL_COUNT(r, nf)                                                         \
+    static void kernel_count_##r##_##nf(const StageKernel* k, const Pair* pairs,    \
+        const uint32_t* d1, const uint32_t* d2, size_t m, uint64_t tab[2][16][16])  \
+    {                                                                               \
+        kernel_count(k, r, nf, pairs, d1, d2, m, tab);                              \
+    }
+#define KERNEL_COUNT_ROUND(r) \
+    KERNEL_COUNT(r, 0) KERNEL_COUNT(r, 1) KERNEL_COUNT(r, 2) KERNEL_COUNT(r, 3) KERNEL_COUNT(r, 4)
+
+KERNEL_COUNT_ROUND(0)
+KERNEL_COUNT_ROUND(1)
+KERNEL_COUNT_ROUND(2)
+
+#define KERNEL_COUNT_ROW(r) \
+    { kernel_count_##r##_0, kernel_count_##r##_1, kernel_count_##r##_2, kernel_count_##r##_3, kernel_count_##r##_4 }
+
+static const KernelCountFn kernel_counts[3][KERNEL_FIXED + 1] = {
+    KERNEL_COUNT_ROW(0), KERNEL_COUNT_ROW(1), KERNEL_COUNT_ROW(2)
+};
+
+#undef KERNEL_COUNT_ROW
+#undef KERNEL_COUNT_ROUND
+#undef KERNEL_COUNT
 
-    FILE* fp = fopen(dataset_path, "rb");
-    if (!fp) {
-        perror("open dataset");
+/* -------------------------------------------------------------------------- */
+/*  Stage scheduling                                                          */
+/* -------------------------------------------------------------------------- */
+#define SCAN_STAGES  8                         /* stages counted in one data pass  */
+#define SCAN_PAIRS   (1 << 16)                 /* pairs per thread chunk of a pass  */
+
+/* right_keys[round] positions the approximation of `stage` reads (bit mask) */
+static unsigned stage_deps(int stage)
+{
+    const StageTerms* st = &stage_terms[stage];
+    unsigned deps = 0;
+    for (int t = 0; t < st->nterms; ++t)
+        if (st->term[t].pos != KEY_GUESS)
+            deps |= 1u << st->term[t].pos;
+    return deps;
+}
+
+/* Nibble shared by all terms of `stage` on key position `pos`, or NIB_MIXED */
+static int stage_pos_nibble(int stage, int pos)
+{
+    const StageTerms* st = &stage_terms[stage];
+    int nib = NIB_MIXED;
+    for (int t = 0; t < st->nterms; ++t) {
+        if (st->term[t].pos != pos)
+            continue;
+        if (nib != NIB_MIXED && nib != st->term[t].nib)
+            return NIB_MIXED;
+        nib = st->term[t].nib;
+    }
+    return nib;
+}
+
+/*
+ * One stage of a data pass.  A stage whose dependencies are all known counts
+ * dist[p][x] as before (y = 0).  A stage that still lacks exactly one key
+ * nibble, produced by another stage of the same pass, is counted jointly
+ * over that nibble's input y: tab[p0][y][x] with the missing key taken as 0,
+ * and folded into dist once the producer has been resolved.
+ */
+typedef struct {
+    int      stage;
+    int      joint;          /* missing right_keys position, or ‑1     */
+    int      joint_nib;      /* SboxTerm.nib of the terms on `joint`   */
+    uint64_t need;           /* pairs this stage counts (cut on settling) */
+    uint64_t used;           /* pairs actually counted                 */
+    uint64_t tab[2][16][16]; /* [p0][y][x]                             */
+} ScanStage;
+
+/*
+ * Picks the stages of the next data pass from the DAG "stage needs the key
+ * nibble another stage recovers": every pending stage whose dependencies are
+ * known, plus — repeated to a fixed point — every stage with a single
+ * unknown dependency that a stage already in the pass recovers.  The pass
+ * lists its stages in an order where producers precede their consumers.
+ * With the approximations of this attack each round takes two passes,
+ * {0,1,2,3} and {4,5,6,7}, instead of eight.
+ */
+static int next_pass(unsigned todo, unsigned known, int round, int shift, ScanStage ss[SCAN_STAGES])
+{
+    unsigned taken = 0, made = 0;
+    int ns = 0, grown = 1;
+
+    while (grown) {
+        grown = 0;
+        for (int stage = 0; stage < 8; ++stage) {
+            if (!((todo >> stage) & 1) || ((taken >> stage) & 1))
+                continue;
+
+            unsigned unknown = stage_deps(stage) & ~known;
+            int joint = -1, nib = 0;
+            if (unknown) {
+                if ((unknown & (unknown - 1)) || !(unknown & made))
+                    continue;
+                for (joint = 0; !((unknown >> joint) & 1); ++joint)
+                    ;
+                nib = stage_pos_nibble(stage, joint);
+                if (nib == NIB_MIXED)
+                    continue;
+            }
+
+            memset(&ss[ns], 0, sizeof(ss[ns]));
+            ss[ns].stage = stage;
+            ss[ns].joint = joint;
+            ss[ns].joint_nib = nib;
+            ss[ns].need = stage_need(round, stage, shift);
+            ++ns;
+            taken |= 1u << stage;
+            made |= 1u << stage_to_pos(stage);
+            grown = 1;
+        }
+    }
+    return ns;
+}
+
+/*
+ * d1 / d2 of rounds 1 and 2 depend only on the pair and on right_keys[0]
+ * (and right_keys[1]), which are final once their round is over.  The first
+ * pass that needs a column computes it and stores it; every later pass and
+ * round reads it back instead of decrypting again.  A column lives in
+ * memory up to mem_max bytes (DCOL_MEM_MAX for a single attack), otherwise
+ * in a sidecar file next to the dataset ("<dataset>.d1" / ".d2", removed
+ * afterwards).
+ */
+typedef struct {
+    uint64_t  cap;          /* pairs the column can hold, 0 = no cache */
+    uint64_t  valid;        /* pairs 0 … valid‑1 are stored            */
+    uint32_t* mem;          /* in‑memory column, or NULL → file        */
+    DataFile  file;
+    char      path[DATA_PATH_MAX];
+    int       failed;       /* a store failed during the current pass  */
+} DColumn;
+
+static void dcol_open(DColumn* col, uint64_t pairs, uint64_t mem_max, const char* sidecar, const char* suffix)
+{
+    memset(col, 0, sizeof(*col));
+    if (pairs * sizeof(uint32_t) <= mem_max && (size_t)pairs == pairs) {
+        col->mem = malloc(sizeof(uint32_t) * (size_t)pairs);
+        if (col->mem) {
+            col->cap = pairs;
+            return;
+        }
+    }
+    if (sidecar) {
+        int w = snprintf(col->path, sizeof(col->path), "%s%s", sidecar, suffix);
+        if (w > 0 && w < (int)sizeof(col->path) && data_file_open(&col->file, col->path, DATA_FILE_WRITE)) {
+            if (data_file_resize(&col->file, pairs * sizeof(uint32_t))) {
+                col->cap = pairs;
+                return;
+            }
+            data_file_close(&col->file);
+            remove(col->path);
+        }
+    }
+    /* no room anywhere: the column is recomputed on every pass */
+}
+
+static void dcol_close(DColumn* col)
+{
+    if (col->mem) {
+        free(col->mem);
+    }
+    else if (col->cap) {
+        data_file_close(&col->file);
+        remove(col->path);
+    }
+    memset(col, 0, sizeof(*col));
+}
+
+/* Values of pairs first … first+n‑1 if stored (read into buf for a sidecar), else NULL */
+static const uint32_t* dcol_get(DColumn* col, uint64_t first, size_t n, uint32_t* buf)
+{
+    if (first + n > col->valid)
+        return NULL;
+    if (col->mem)
+        return col->mem + first;
+    if (data_file_pread(&col->file, buf, n * sizeof(uint32_t), first * sizeof(uint32_t)) != n * sizeof(uint32_t))
+        return NULL;
+    return buf;
+}
+
+static void dcol_put(DColumn* col, uint64_t first, size_t n, const uint32_t* d)
+{
+    if (first >= col->cap)
         return;
+    if (col->cap - first < n)
+        n = (size_t)(col->cap - first);
+    if (col->mem) {
+        memcpy(col->mem + first, d, n * sizeof(uint32_t));
+    }
+    else if (!data_file_pwrite(&col->file, d, n * sizeof(uint32_t), first * sizeof(uint32_t))) {
+#pragma omp critical(dcol_failed)
+        col->failed = 1;
     }
+}
 
-    Pair* buffer = malloc(sizeof(Pair) * 2 * BUFFER_PAIRS);
-    if (!buffer) {
-        puts("malloc fail");
-        fclose(fp);
+/* After a pass that stored pairs 0 … scanned‑1 */
+static void dcol_commit(DColumn* col, uint64_t scanned)
+{
+    if (col->cap && !col->failed && scanned > col->valid)
+        col->valid = scanned < col->cap ? scanned : col->cap;
+    col->failed = 0;
+}
+
+/*
+ * dist[p][x] of a scanned stage.  For a joint stage the terms on the missing
+ * position were evaluated with key 0; with g(v) their XOR at nibble value v,
+ * the true parity is p0 ^ g(y) ^ g(y ^ k) for the now recovered k.
+ */
+static void fold_stage(const ScanStage* s, const uint8_t rk[9], uint64_t dist[2][16])
+{
+    extern uint8_t S[16];
+    int g[16] = { 0 };
+
+    if (s->joint >= 0) {
+        const StageTerms* st = &stage_terms[s->stage];
+        for (int v = 0; v < 16; ++v)
+            for (int t = 0; t < st->nterms; ++t)
+                if (st->term[t].pos == s->joint)
+                    g[v] ^= (S[v] >> st->term[t].bit) & 1;
+    }
+
+    int k = s->joint >= 0 ? rk[s->joint] : 0;
+    memset(dist, 0, sizeof(uint64_t) * 2 * 16);
+    for (int p = 0; p < 2; ++p)
+        for (int y = 0; y < 16; ++y)
+            for (int x = 0; x < 16; ++x)
+                dist[p ^ g[y] ^ g[y ^ k]][x] += s->tab[p][y][x];
+}
+
+/*
+ * Log‑likelihood L[kp][kx] = corr²/(2N) (= 2·d²/N) of every pair of joint
+ * key kp and guess kx of a scanned stage, all 256 from one Walsh–Hadamard
+ * correlation of tab[p0][y][x].  p0 holds the joint terms under key 0, g(y),
+ * which is divided out before the kernel puts back g(y ^ kp).  A stage
+ * without a joint nibble has the same row for every kp.
+ */
+static void stage_joint_scores(const ScanStage* s, double L[16][16])
+{
+    extern uint8_t S[16];
+    const StageTerms* st = &stage_terms[s->stage];
+    int bit = stage_guess_bit(s->stage);
+    uint16_t g[2] = { 0, 0 };
+    int64_t a[256];
+
+    for (int v = 0; v < 16; ++v)
+        g[0] |= (uint16_t)(((S[v] >> bit) & 1) << v);
+    if (s->joint >= 0)
+        for (int t = 0; t < st->nterms; ++t)
+            if (st->term[t].pos == s->joint)
+                for (int v = 0; v < 16; ++v)
+                    g[1] ^= (uint16_t)(((S[v] >> st->term[t].bit) & 1) << v);
+
+    memset(a, 0, sizeof(a));
+    for (int y = 0; y < 16; ++y) {
+        for (int x = 0; x < 16; ++x) {
+            int64_t c = (int64_t)s->tab[0][y][x] - (int64_t)s->tab[1][y][x];
+            if ((g[1] >> y) & 1)
+                c = -c;
+            /* without a joint nibble y is always 0: only x is guessed */
+            a[s->joint >= 0 ? (y << 4) | x : x] += c;
+        }
+    }
+    fwht_correlate(a, s->joint >= 0 ? 2 : 1, g);
+
+    for (int kp = 0; kp < 16; ++kp) {
+        for (int kx = 0; kx < 16; ++kx) {
+            double c = (double)a[s->joint >= 0 ? (kp << 4) | kx : kx];
+            L[kp][kx] = s->used ? c * c / (2.0 * (double)s->used) : 0.0;
+        }
+    }
+}
+
+/*
+ * Max‑sum over the stages of a pass.  Every joint stage scores all (producer
+ * key, guess) pairs with stage_joint_scores(), and the stages form a forest
+ * (each consumer has one producer, earlier in ss), so one recursion gives
+ * every stage and guess the best total log‑likelihood of the pass with that
+ * guess, its max‑marginal M: up[] collects the best of each subtree, M[]
+ * adds the best of the rest of the tree.  A joint nibble found by an
+ * earlier pass is taken from right_keys.
+ */
+static void pass_max_marginals(const ScanStage* ss,
+    int ns,
+    const uint8_t right_keys[9],
+    double L[SCAN_STAGES][16][16],
+    double M[SCAN_STAGES][16])
+{
+    double up[SCAN_STAGES][16], msg[SCAN_STAGES][16];
+    int parent[SCAN_STAGES];
+
+    memset(up, 0, sizeof(up));
+    for (int j = 0; j < ns; ++j) {
+        stage_joint_scores(&ss[j], L[j]);
+        parent[j] = -1;
+        for (int i = 0; i < j; ++i)
+            if (ss[j].joint >= 0 && stage_to_pos(ss[i].stage) == ss[j].joint)
+                parent[j] = i;
+    }
+
+    /* children follow their producer: fold subtrees upwards */
+    for (int j = ns - 1; j >= 0; --j) {
+        if (parent[j] < 0)
+            continue;
+        for (int kp = 0; kp < 16; ++kp) {
+            double m = -1.0;
+            for (int kx = 0; kx < 16; ++kx)
+                if (L[j][kp][kx] + up[j][kx] > m)
+                    m = L[j][kp][kx] + up[j][kx];
+            msg[j][kp] = m;
+            up[parent[j]][kp] += m;
+        }
+    }
+
+    for (int j = 0; j < ns; ++j) {
+        int p = parent[j];
+        for (int kx = 0; kx < 16; ++kx) {
+            if (p < 0) {
+                int kp = ss[j].joint >= 0 ? right_keys[ss[j].joint] : 0;
+                M[j][kx] = L[j][kp][kx] + up[j][kx];
+                continue;
+            }
+            double m = -1.0;
+            for (int kp = 0; kp < 16; ++kp)
+                if (L[j][kp][kx] + M[p][kp] - msg[j][kp] > m)
+                    m = L[j][kp][kx] + M[p][kp] - msg[j][kp];
+            M[j][kx] = up[j][kx] + m;
+        }
+    }
+}
+
+/*
+ * Early‑stopping test after `boundary` pairs: every stage still counting
+ * whose leading guess is settled on its max‑marginals gets need = boundary.
+ * This is the rule resolve_pass() decides by, so a joint stage need not
+ * wait for its producer: the max‑marginal already weighs every producer
+ * key.  Returns the pass's new max(need).
+ */
+static uint64_t settle_stages(int round,
+    const uint8_t right_keys[9],
+    ScanStage* ss,
+    int ns,
+    uint64_t boundary,
+    double z)
+{
+    double L[SCAN_STAGES][16][16], M[SCAN_STAGES][16];
+    uint64_t need = 0;
+
+    pass_max_marginals(ss, ns, right_keys, L, M);
+    for (int j = 0; j < ns; ++j) {
+        ScanStage* s = &ss[j];
+        int best;
+        if (s->need > boundary && stage_settled(M[j], z, &best)) {
+            if (!g_quiet)
+                printf("\n[Round %d, Stage %d] settled after %llu of %llu pairs",
+                    round, s->stage, (unsigned long long)s->used, (unsigned long long)s->need);
+            s->need = boundary;
+        }
+        if (s->need > need)
+            need = s->need;
+    }
+    return need;
+}
+
+/* Adds a thread's tables to ss and clears them */
+static void merge_counts(ScanStage* ss, int ns, uint64_t (*local)[2][16][16], uint64_t counted[SCAN_STAGES])
+{
+    for (int j = 0; j < ns; ++j) {
+#pragma omp atomic
+        ss[j].used += counted[j];
+        counted[j] = 0;
+        for (int v = 0; v < 2 * 16 * 16; ++v) {
+            uint64_t n = local[j][v >> 8][(v >> 4) & 0xF][v & 0xF];
+            if (!n)
+                continue;
+#pragma omp atomic
+            ss[j].tab[v >> 8][(v >> 4) & 0xF][v & 0xF] += n;
+            local[j][v >> 8][(v >> 4) & 0xF][v & 0xF] = 0;
+        }
+    }
+}
+
+/*
+ * Durable attack state.  It is rewritten after every resolved stage and,
+ * inside a pass, at a segment boundary at most every CKPT_SECONDS, so a
+ * resumed run (--resume) continues with the same finished nibbles and the
+ * same partial tables from the same pair offset.  The file is replaced in
+ * one step (write "<path>.tmp", sync, rename), so a crash mid‑save leaves
+ * the previous checkpoint intact.
+ */
+typedef struct {
+    uint32_t   magic;                 /* CKPT_MAGIC                          */
+    uint32_t   version;               /* CKPT_VERSION                        */
+    uint32_t   size;                  /* sizeof(CheckpointState): the file is
+                                         a raw dump, so a build with another
+                                         layout must not read it             */
+    uint32_t   reserved;
+    uint64_t   pairs;                 /* dataset identity: pairs, seed, key  */
+    uint64_t   seed;
+    uint64_t   key_fp;
+    int32_t    shift;                 /* AttackOptions that change counts    */
+    double     stop_z;
+    int32_t    round;                 /* round in progress                   */
+    uint32_t   todo;                  /* its stages still to run             */
+    uint32_t   known;                 /* its right_keys positions found      */
+    uint8_t    right_keys[3][9];
+    KeyRanking rank[3][9];
+    int32_t    ns;                    /* stages of the pass in progress, or 0 */
+    uint64_t   offset;                /* pairs 0 … offset‑1 are in ss        */
+    ScanStage  ss[SCAN_STAGES];
+} CheckpointState;
+
+typedef struct {
+    const char*     path;             /* NULL: no checkpoints                */
+    double          saved;            /* omp_get_wtime() of the last save    */
+    CheckpointState st;
+} Checkpoint;
+
+static void checkpoint_save(Checkpoint* ck)
+{
+    char tmp[DATA_PATH_MAX + 8];
+    DataFile f;
+    int ok = 0;
+
+    ck->saved = omp_get_wtime();
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", ck->path) >= (int)sizeof(tmp))
         return;
+    if (data_file_open(&f, tmp, DATA_FILE_WRITE)) {
+        ok = data_file_pwrite(&f, &ck->st, sizeof(ck->st), 0) && data_file_sync(&f);
+        data_file_close(&f);
+        ok = ok && data_file_replace(tmp, ck->path);
     }
+    if (!ok)
+        printf("\n[!] checkpoint %s not written\n", ck->path);
+}
 
-    puts("[*] Start Linear Cryptanalysis");
+/* Returns 1 if ck->path holds a checkpoint for this dataset and these options */
+static int checkpoint_load(Checkpoint* ck, const DataSource* src, int shift, double stop_z)
+{
+    DataFile f;
+    CheckpointState st;
 
-    for (int round = 0; round < 3; ++round) {
-        for (int stage = 0; stage < 8; ++stage) {
-            rewind(fp);
-            uint64_t bucket[MAX_KEYS] = { 0 };
-            uint64_t need = 1ULL << stage_exp[round][stage];
-            uint64_t used = 0;
-            double t0 = omp_get_wtime();
-
-            while (used < need) {
-                size_t want = BUFFER_PAIRS;
-                if (used + want > need)
-                    want = (size_t)(need - used);
-                size_t n = fread(buffer, sizeof(Pair), want, fp);
-                if (!n)
-                    break;
-
-#pragma omp parallel for schedule(static)
-                for (int key_idx = 0; key_idx < MAX_KEYS; ++key_idx) {
-                    uint64_t local_sum = 0;
-                    uint32_t key = (uint32_t)key_idx;
-
-                    for (size_t i = 0; i < n; ++i) {
-                        uint64_t P = buffer[i].plaintext;
-                        uint64_t C = buffer[i].ciphertext;
-                        uint32_t d1 = 0, d2 = 0;
-                        uint64_t t = 0;
-
-                        /* Round‑specific linear approximations */
-                        if (round == 0) {
-                            uint8_t rotated_C = ((((C >> 15) & 0xE)) ^ ((C >> 31) & 1)) & 0xF;
-
-                            /* Stage‑by‑stage boolean expressions */
-                            if (stage == 0) {
-                                t = (P >> 48) & 1;
-                                t ^= (C >> 48) & 1;
-                                t ^= (C >> 16) & 1;
-                                t ^= S[(rotated_C ^ key) & 0xF] & 1;
-                            }
-                            else if (stage == 1) {
-                                t = (P >> 48) & 1;
-                                t ^= (C >> 16) & 1;
-                                t ^= (C >> 50) & 1;
-                                t ^= (S[(((C >> 8) & 0xF) ^ key) & 0xF] >> 2) & 1;
-                            }
-                            else if (stage == 2) {
-                                t = (P >> 48) & 1;
-                                t ^= (C >> 16) & 1;
-                                t ^= (C >> 50) & 1;
-                                t ^= (C >> 63) & 1;
-                                t ^= (S[(((C >> 8) & 0xF) ^ right_keys[round][1]) & 0xF] >> 2) & 1;
-                                t ^= S[(((C >> 19) & 0xF) ^ key) & 0xF] & 1;
-                            }
-                            else if (stage == 3) {
-                                t = (P >> 48) & 1;
-                                t ^= (C >> 16) & 1;
-                                t ^= (C >> 49) & 1;
-                                t ^= (C >> 63) & 1;
-                                t ^= S[(((C >> 19) & 0xF) ^ right_keys[round][5]) & 0xF] & 1;
-                                t ^= S[(((C >> 27) & 0xF) ^ key) & 0xF] & 1;
-                            }
-                            else if (stage == 4) {
-                                t = (P >> 16) & 1;
-                                t ^= ((C >> 18) & 1) ^ ((C >> 40) & 1) ^ ((C >> 43) & 1) ^ ((C >> 48) & 1);
-                                t ^= S[(rotated_C ^ right_keys[round][8]) & 0xF] & 1;
-                                t ^= (S[(((C >> 8) & 0xF) ^ right_keys[round][1]) & 0xF] >> 1) & 1;
-                                t ^= (S[(((C >> 4) & 0xF) ^ key) & 0xF] >> 1) & 1;
-                            }
-                            else if (stage == 5) {
-                                t = (P >> 16) & 1;
-                                t ^= ((C >> 18) & 1) ^ ((C >> 41) & 1) ^ ((C >> 43) & 1) ^ ((C >> 48) & 1);
-                                t ^= S[(rotated_C ^ right_keys[round][8]) & 0xF] & 1;
-                                t ^= (S[(((C >> 8) & 0xF) ^ right_keys[round][1]) & 0xF] >> 1) & 1;
-                                t ^= S[(((C >> 23) & 0xF) ^ key) & 0xF] & 1;
-                            }
-                            else if (stage == 6) {
-                                t = (P >> 16) & 1;
-                                t ^= ((C >> 17) & 1) ^ ((C >> 31) & 1) ^ ((C >> 48) & 1) ^ ((C >> 51) & 1) ^
-                                    ((C >> 53) & 1) ^ ((C >> 59) & 1) ^ ((C >> 61) & 1);
-                                t ^= S[(rotated_C ^ right_keys[round][8]) & 0xF] & 1;
-                                t ^= (S[(rotated_C ^ right_keys[round][8]) & 0xF] >> 3) & 1;
-                                t ^= (S[(((C >> 19) & 0xF) ^ right_keys[round][5]) & 0xF] >> 3) & 1;
-                                t ^= (S[(((C >> 4) & 0xF) ^ right_keys[round][4]) & 0xF] >> 2) & 1;
-                                t ^= (S[(((C >> 12) & 0xF) ^ key) & 0xF] >> 1) & 1;
-                            }
-                            else if (stage == 7) {
-                                t = (P >> 16) & 1;
-                                t ^= ((C >> 17) & 1) ^ ((C >> 31) & 1) ^ ((C >> 48) & 1) ^ ((C >> 51) & 1) ^
-                                    ((C >> 53) & 1) ^ ((C >> 60) & 1);
-                                t ^= S[(rotated_C ^ right_keys[round][8]) & 0xF] & 1;
-                                t ^= (S[(((C >> 19) & 0xF) ^ right_keys[round][5]) & 0xF] >> 3) & 1;
-                                t ^= (S[(((C >> 12) & 0xF) ^ right_keys[round][2]) & 0xF] >> 1) & 1;
-                                t ^= (S[((C & 0xF) ^ key) & 0xF] >> 3) & 1;
-                            }
+    if (!data_file_open(&f, ck->path, DATA_FILE_READ))
+        return 0;
+    size_t got = data_file_pread(&f, &st, sizeof(st), 0);
+    data_file_close(&f);
+
+    if (got != sizeof(st) || st.magic != CKPT_MAGIC || st.version != CKPT_VERSION
+        || st.pairs != src->pairs || st.seed != src->seed || st.key_fp != src->key_fp
+        || st.shift != shift || st.stop_z != stop_z
+        || st.size != (uint32_t)sizeof(st)
+        || st.round < 0 || st.round > 2 || st.todo > 0xFF || (st.known >> 9) != 0
+        || st.ns < 0 || st.ns > SCAN_STAGES
+        || (st.ns > 0 && st.offset % SCAN_PAIRS != 0))
+        return 0;
+    ck->st = st;
+    return 1;
+}
+
+/* Snapshot of a pass in progress after its first `offset` pairs */
+static void checkpoint_pass(Checkpoint* ck, const ScanStage* ss, int ns, uint64_t offset)
+{
+    ck->st.ns = ns;
+    ck->st.offset = offset;
+    memcpy(ck->st.ss, ss, sizeof(ScanStage) * (size_t)ns);
+    checkpoint_save(ck);
+}
+
+/* State after a resolved stage, between passes */
+static void checkpoint_stage(Checkpoint* ck, int round, unsigned todo, unsigned known,
+    uint8_t right_keys[3][9], KeyRanking rank[3][9])
+{
+    if (!ck->path)
+        return;
+    ck->st.round = round;
+    ck->st.todo = todo;
+    ck->st.known = known;
+    memcpy(ck->st.right_keys, right_keys, sizeof(ck->st.right_keys));
+    memcpy(ck->st.rank, rank, sizeof(ck->st.rank));
+    ck->st.ns = 0;
+    ck->st.offset = 0;
+    checkpoint_save(ck);
+}
+
+/*
+ * One scan over the first max(need) pairs that fills tab[][][] of every
+ * stage in ss; stage j only counts pairs below its own need.  A single
+ * parallel region covers the whole pass: each thread claims SCAN_PAIRS
+ * chunks, reads them into its own buffers, takes d1 / d2 from the column
+ * cache (or decrypts and stores them) once for all stages, and counts into
+ * private tables that are merged once at the end — or, with stop_z > 0,
+ * every STOP_CHECK pairs, where settle_stages() may end stages early, and
+ * with a checkpoint at the first STOP_CHECK boundary after CKPT_SECONDS,
+ * where the pass is saved.
+ * A resumed pass starts at `start` (a multiple of SCAN_PAIRS) with the
+ * tables of pairs 0 … start‑1 already in ss.
+ * Returns 0 if a thread could not allocate its buffers.
+ */
+static int scan_pass(DataSource* src,
+    int round,
+    uint8_t right_keys[3][9],
+    ScanStage* ss,
+    int ns,
+    uint64_t start,
+    double stop_z,
+    Checkpoint* ck,
+    DColumn dcol[2])
+{
+    uint8_t rk[9];
+    StageKernel kern[SCAN_STAGES];
+    uint64_t need = 0, done = start;
+    uint64_t stored = UINT64_MAX;   /* end of the first chunk that came back short */
+    int failed = 0, due = 0;
+    char names[2 * SCAN_STAGES + 1] = "";
+    double t0 = omp_get_wtime(), last = t0;
+
+    /* Missing nibbles are counted as 0 and corrected when folding */
+    memcpy(rk, right_keys[round], sizeof(rk));
+    for (int j = 0; j < ns && j < SCAN_STAGES; ++j) {
+        if (ss[j].joint >= 0)
+            rk[ss[j].joint] = 0;
+        if (ss[j].need > need)
+            need = ss[j].need;
+        names[2 * j] = (char)(j ? ',' : ' ');
+        names[2 * j + 1] = (char)('0' + ss[j].stage);
+        names[2 * j + 2] = '\0';
+    }
+    for (int j = 0; j < ns && j < SCAN_STAGES; ++j)
+        stage_kernel(round, ss[j].stage, rk, ss[j].joint, ss[j].joint_nib, &kern[j]);
+
+    uint32_t rk24 = convert_key_array_to_uint32(right_keys[0]);
+    uint32_t rk23 = convert_key_array_to_uint32(right_keys[1]);
+    int64_t chunks = (int64_t)((need + SCAN_PAIRS - 1) / SCAN_PAIRS);
+    int64_t seg = (stop_z > 0 || ck->path) ? STOP_CHECK / SCAN_PAIRS : chunks;
+
+#pragma omp parallel
+    {
+        /* Thread‑private: separate heap blocks, so no two threads share a line */
+        Pair* buffer = malloc(sizeof(Pair) * SCAN_PAIRS);
+        uint64_t* cts = malloc(sizeof(uint64_t) * SCAN_PAIRS);
+        uint32_t* d1buf = malloc(sizeof(uint32_t) * SCAN_PAIRS);
+        uint32_t* d2buf = malloc(sizeof(uint32_t) * SCAN_PAIRS);
+        uint64_t (*local)[2][16][16] = calloc((size_t)ns, sizeof(*local));
+        uint64_t counted[SCAN_STAGES] = { 0 };
+        int64_t c = 0;
+
+        if (!buffer || !cts || !d1buf || !d2buf || !local) {
+#pragma omp critical(scan_failed)
+            failed = 1;
+        }
+
+        /* Every chunk is read exactly once and in claim order, as the read‑ahead stream requires */
+#pragma omp barrier
+#pragma omp single
+        {
+            if (failed)
+                chunks = 0;
+            else
+                data_source_stream(src, start, need - start, SCAN_PAIRS);
+        }
+
+        /* Segments of seg chunks; the tables are merged after each to be tested or saved */
+        for (int64_t s0 = (int64_t)(start / SCAN_PAIRS); s0 < chunks; s0 += seg) {
+            int64_t s1 = (chunks - s0 < seg) ? chunks : s0 + seg;
+#pragma omp for schedule(dynamic)
+            for (c = s0; c < s1; ++c) {
+                uint64_t first = (uint64_t)c * SCAN_PAIRS;
+                size_t want = (need - first < SCAN_PAIRS) ? (size_t)(need - first) : SCAN_PAIRS;
+                const Pair* pairs = buffer;
+                size_t n = data_source_view(src, first, want, &pairs);
+                if (!n) {
+                    pairs = buffer;
+                    n = data_source_read(src, first, want, buffer);
+                }
+                if (n < want) {
+#pragma omp critical(scan_short)
+                    {
+                        if (first + n < stored)
+                            stored = first + n;
+                    }
+                }
+
+                /* d1 / d2 depend only on the pair, not on the key guess: stored columns, or batch once */
+                const uint32_t* d1 = NULL;
+                const uint32_t* d2 = NULL;
+                if (round > 0 && n) {
+                    d1 = dcol_get(&dcol[0], first, n, d1buf);
+                    if (round == 2)
+                        d2 = dcol_get(&dcol[1], first, n, d2buf);
+                    if (!d1 || (round == 2 && !d2)) {
+                        for (size_t i = 0; i < n; ++i)
+                            cts[i] = pairs[i].ciphertext;
+                        decrypt_half_batch(cts, n, rk24, rk23, d1buf, round == 2 ? d2buf : NULL);
+                        if (!d1)
+                            dcol_put(&dcol[0], first, n, d1buf);
+                        if (round == 2)
+                            dcol_put(&dcol[1], first, n, d2buf);
+                        d1 = d1buf;
+                        d2 = d2buf;
+                    }
+                }
+
+                for (int j = 0; j < ns; ++j) {
+                    size_t m = (first >= ss[j].need) ? 0
+                        : (ss[j].need - first < n) ? (size_t)(ss[j].need - first) : n;
+                    counted[j] += m;
+                    kernel_counts[round][kern[j].nfixed](&kern[j], pairs, d1, d2, m, local[j]);
+                }
+
+#pragma omp atomic
+                done += n;
+
+                if (!g_quiet && omp_get_thread_num() == 0 && omp_get_wtime() - last > 0.5) {
+#pragma omp flush(done)
+                    uint64_t d = done;
+                    last = omp_get_wtime();
+                    double prog = (double)d / need;
+                    double eta = prog ? (last - t0) * (1.0 / prog - 1.0) : 0.0;
+                    printf("\r[Round %d, Stages%s] %.1f%% | %llu/%llu | ETA %.1fs ",
+                        round, names, ((int)(prog * 1000)) / 10.0,
+                        (unsigned long long)d, (unsigned long long)need, eta);
+                    fflush(stdout);
+                }
+            }
+
+            /* merge only when a test or a save is due: every segment, or once a minute */
+            if (seg < chunks) {
+#pragma omp single
+                due = s1 < chunks
+                    && (stop_z > 0 || (ck->path && omp_get_wtime() - ck->saved >= CKPT_SECONDS));
+                if (due) {
+                    merge_counts(ss, ns, local, counted);
+#pragma omp barrier
+#pragma omp single
+                    {
+                        if (stop_z > 0) {
+                            need = settle_stages(round, right_keys[round], ss, ns,
+                                (uint64_t)s1 * SCAN_PAIRS, stop_z);
+                            chunks = (int64_t)((need + SCAN_PAIRS - 1) / SCAN_PAIRS);
                         }
-                        else if (round == 1) {
-                            d1 = decrypt_half_one_round(C, right_keys[0]);
-
-                            if (stage == 0) {
-                                t = (d1 >> 16) & 1;
-                                t ^= (P >> 16) & 1;
-                                t ^= (C >> 16) & 1;
-                                t ^= substitute_with_sbox((((d1 >> 15) & 0xE) ^ ((d1 >> 31) & 1)) ^ key) & 1;
-                            }
-                            else if (stage == 1) {
-                                t = (P >> 16) & 1;
-                                t ^= (C >> 18) & 1;
-                                t ^= (d1 >> 16) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 8) & 0xF) ^ key) >> 2) & 1;
-                            }
-                            else if (stage == 2) {
-                                t = (P >> 16) & 1;
-                                t ^= (C >> 18) & 1;
-                                t ^= (C >> 31) & 1;
-                                t ^= (d1 >> 16) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 8) & 0xF) ^ right_keys[round][1]) >> 2) & 1;
-                                t ^= substitute_with_sbox(((d1 >> 19) & 0xF) ^ key) & 1;
-                            }
-                            else if (stage == 3) {
-                                t = (P >> 16) & 1;
-                                t ^= (C >> 17) & 1;
-                                t ^= (C >> 31) & 1;
-                                t ^= (d1 >> 16) & 1;
-                                t ^= substitute_with_sbox(((d1 >> 19) & 0xF) ^ right_keys[round][5]) & 1;
-                                t ^= substitute_with_sbox(((d1 >> 27) & 0xF) ^ key) & 1;
-                            }
-                            else if (stage == 4) {
-                                t = (P >> 48) & 1;
-                                t ^= (P >> 16) & 1;
-                                t ^= (C >> 8) & 1;
-                                t ^= (C >> 11) & 1;
-                                t ^= (C >> 16) & 1;
-                                t ^= (d1 >> 18) & 1;
-                                t ^= substitute_with_sbox((((d1 >> 15) & 0xE) ^ ((d1 >> 31) & 1)) ^ right_keys[round][8]) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 8) & 0xF) ^ right_keys[round][1]) >> 1) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 4) & 0xF) ^ key) >> 1) & 1;
-                            }
-                            else if (stage == 5) {
-                                t = (P >> 48) & 1;
-                                t ^= (P >> 16) & 1;
-                                t ^= (C >> 9) & 1;
-                                t ^= (C >> 11) & 1;
-                                t ^= (C >> 16) & 1;
-                                t ^= (d1 >> 18) & 1;
-                                t ^= substitute_with_sbox((((d1 >> 15) & 0xE) ^ ((d1 >> 31) & 1)) ^ right_keys[round][8]) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 8) & 0xF) ^ right_keys[round][1]) >> 1) & 1;
-                                t ^= substitute_with_sbox(((d1 >> 23) & 0xF) ^ key) & 1;
-                            }
-                            else if (stage == 6) {
-                                t = (P >> 48) & 1;
-                                t ^= (P >> 16) & 1;
-                                t ^= (C >> 16) & 1;
-                                t ^= (C >> 19) & 1;
-                                t ^= (C >> 21) & 1;
-                                t ^= (C >> 27) & 1;
-                                t ^= (C >> 29) & 1;
-                                t ^= (d1 >> 17) & 1;
-                                t ^= (d1 >> 31) & 1;
-                                t ^= substitute_with_sbox((((d1 >> 15) & 0xE) ^ ((d1 >> 31) & 1)) ^ right_keys[round][8]) & 1;
-                                t ^= (substitute_with_sbox((((d1 >> 15) & 0xE) ^ ((d1 >> 31) & 1)) ^ right_keys[round][8]) >> 3) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 19) & 0xF) ^ right_keys[round][5]) >> 3) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 4) & 0xF) ^ right_keys[round][4]) >> 2) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 12) & 0xF) ^ key) >> 1) & 1;
-                            }
-                            else if (stage == 7) {
-                                t = (P >> 48) & 1;
-                                t ^= (P >> 16) & 1;
-                                t ^= (C >> 16) & 1;
-                                t ^= (C >> 19) & 1;
-                                t ^= (C >> 21) & 1;
-                                t ^= (C >> 28) & 1;
-                                t ^= (d1 >> 17) & 1;
-                                t ^= (d1 >> 31) & 1;
-                                t ^= substitute_with_sbox((((d1 >> 15) & 0xE) ^ ((d1 >> 31) & 1)) ^ right_keys[round][8]) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 19) & 0xF) ^ right_keys[round][5]) >> 3) & 1;
-                                t ^= (substitute_with_sbox(((d1 >> 12) & 0xF) ^ right_keys[round][2]) >> 1) & 1;
-                                t ^= (substitute_with_sbox((d1 & 0xF) ^ key) >> 3) & 1;
+                        if (s1 < chunks && ck->path && omp_get_wtime() - ck->saved >= CKPT_SECONDS)
+                            checkpoint_pass(ck, ss, ns, (uint64_t)s1 * SCAN_PAIRS);
+                    }
+                }
+            }
+        }
+
+        if (!failed)
+            merge_counts(ss, ns, local, counted);
+        free(buffer);
+        free(cts);
+        free(d1buf);
+        free(d2buf);
+        free(local);
+    }
+
+    data_source_stream_end(src);
+    /*
+     * A resumed pass did not store the columns below `start`, and a short
+     * read leaves a hole: only the prefix before the first one is valid.
+     */
+    if (round > 0 && !failed && start == 0) {
+        if (stored > done)
+            stored = done;
+        dcol_commit(&dcol[0], stored);
+        if (round == 2)
+            dcol_commit(&dcol[1], stored);
+    }
+    if (!g_quiet)
+        puts("");
+    return !failed;
+}
+
+/*
+ * Ranks all 16 nibbles by `score` (NULL: stage_scores() of the bucket) and
+ * records `pick` (< 0: the top score).  resolve_pass() passes the stage's
+ * own log‑likelihood given its producer and picks by max‑marginal; should
+ * the two disagree, the pick is moved to the front with its own score, so
+ * key_enum starts from the decided key and every entry keeps its true
+ * log‑likelihood.  Later stages and rounds build on the pick only.
+ */
+static void resolve_stage(int round,
+    int stage,
+    const uint64_t bucket[MAX_KEYS],
+    uint64_t used,
+    const double* score,
+    int pick,
+    uint8_t right_keys[3][9],
+    uint8_t rk_nib[3][9],
+    KeyRanking rank[3][9])
+{
+    int dev = find_max_deviation_index(bucket, used);
+    int pos = stage_to_pos(stage);
+    KeyRanking* r = &rank[round][pos];
+    double own[MAX_KEYS];
+    if (!score) {
+        stage_scores(bucket, used, own);
+        score = own;
+    }
+    key_ranking_init(r, score);
+
+    int best = pick >= 0 ? pick : r->value[0];
+    for (int i = r->n - 1; i > 0 && r->value[0] != best; --i) {
+        if (r->value[i] != best)
+            continue;
+        double s = r->score[i];
+        for (; i > 0; --i) {
+            r->value[i] = r->value[i - 1];
+            r->score[i] = r->score[i - 1];
+        }
+        r->value[0] = (uint8_t)best;
+        r->score[0] = s;
+    }
+    if (best != dev && !g_quiet)
+        printf("[*] Joint likelihood over the pass prefers %d\n", best);
+    right_keys[round][pos] = (uint8_t)best;
+    rk_nib[round][pos] = (uint8_t)best;
+    if (!g_quiet)
+        printf("[Round %d, Stage %d] key[%d] = %d\n", round, stage, pos, best);
+}
+
+/*
+ * Resolves the stages of a scanned pass jointly instead of by chained top‑1
+ * picks: each stage takes the guess with the best max‑marginal (see
+ * pass_max_marginals()), so together they form the most likely joint
+ * assignment — a chain such as stages 1 → 2 → 3 is decided as one 12‑bit
+ * guess.  The max‑marginals all contain the best score of the whole tree,
+ * so they cannot be added across stages; the rankings for key_enum instead
+ * score each guess by the stage's own log‑likelihood given its producer's
+ * decided nibble.  Their sum is the exact joint log‑likelihood of any
+ * combination that keeps the producers at their decided nibbles; one that
+ * changes a producer is scored with its consumers still conditioned on the
+ * decided value.
+ */
+static void resolve_pass(int round,
+    const ScanStage* ss,
+    int ns,
+    uint8_t right_keys[3][9],
+    uint8_t rk_nib[3][9],
+    KeyRanking rank[3][9])
+{
+    double L[SCAN_STAGES][16][16], M[SCAN_STAGES][16];
+
+    pass_max_marginals(ss, ns, right_keys[round], L, M);
+
+    /* Producers precede consumers in ss, so each fold and row sees its key */
+    for (int j = 0; j < ns; ++j) {
+        uint64_t bucket[MAX_KEYS];
+        uint64_t dist[2][16];
+        int pick = 0;
+        for (int kx = 1; kx < 16; ++kx)
+            if (M[j][kx] > M[j][pick])
+                pick = kx;
+        int kp = ss[j].joint >= 0 ? right_keys[round][ss[j].joint] : 0;
+
+        fold_stage(&ss[j], right_keys[round], dist);
+        score_distilled((const uint64_t(*)[16])dist, stage_guess_bit(ss[j].stage), bucket);
+        resolve_stage(round, ss[j].stage, bucket, ss[j].used, L[j][kp], pick, right_keys, rk_nib, rank);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Round‑0 counting over bit planes                                          */
+/* -------------------------------------------------------------------------- */
+
+/* Lanes whose nibble x (four planes, LSB first) equals v */
+static inline uint64_t nibble_is(const uint64_t x[4], int v)
+{
+    return ((v & 1) ? x[0] : ~x[0]) & ((v & 2) ? x[1] : ~x[1])
+        & ((v & 4) ? x[2] : ~x[2]) & ((v & 8) ? x[3] : ~x[3]);
+}
+
+/*
+ * Same buckets as the pair loop for round 0, but reads only the planes that
+ * stage_linear[0][stage] and stage_terms[stage] reference.  The distillation table is filled 64
+ * pairs at a time: for each value v of the active nibble, one popcount of
+ * (x == v) & t gives the p = 1 count and one of (x == v) the total.
+ * The table is s->tab[p][0][x], laid out as scan_pass() counts a round‑0
+ * stage, so the checkpoint of either path resumes in the other.  As there,
+ * with stop_z > 0 the table is tested every STOP_CHECK pairs and the scan
+ * ends once the leading guess is settled (see stage_settled()), and with a
+ * checkpoint it is saved at the first STOP_CHECK boundary after
+ * CKPT_SECONDS.  A resumed stage starts at `start` (a multiple of
+ * SCAN_PAIRS) with pairs 0 … start‑1 already in s->tab.
+ * Returns the number of pairs used (s->need, unless the dataset is shorter
+ * or the stage settled earlier), or 0 if a plane could not be read.
+ */
+static uint64_t count_round0_planes(DataSource* src,
+    const uint8_t rk[9],
+    ScanStage* s,
+    uint64_t start,
+    double stop_z,
+    Checkpoint* ck,
+    uint64_t bucket[MAX_KEYS])
+{
+    extern uint8_t S[16];
+    int stage = s->stage;
+    const StageLinear* ps = &stage_linear[0][stage];
+    const StageTerms* st = &stage_terms[stage];
+
+    uint64_t need = s->need < src->pairs ? s->need : src->pairs;
+    uint64_t words = need / BS_LANES;
+
+    /* Planes this stage reads, and the slot each one gets in the chunk buffer */
+    int slot[DATA_PLANES], planes[DATA_PLANES], np = 0;
+    for (int b = 0; b < DATA_PLANES; ++b)
+        slot[b] = -1;
+#define USE_PLANE(pl) do { if (slot[pl] < 0) { slot[pl] = np; planes[np++] = (pl); } } while (0)
+    for (int b = 0; b < 64; ++b) {
+        if ((ps->p_bits >> b) & 1) USE_PLANE(DATA_PLANE_P(b));
+        if ((ps->c_bits >> b) & 1) USE_PLANE(DATA_PLANE_C(b));
+    }
+    int nib_plane[5][4];
+    for (int t = 0; t < st->nterms; ++t) {
+        for (int i = 0; i < 4; ++i) {
+            int cb = (st->term[t].nib == NIB_ROT) ? (i == 0 ? 31 : 15 + i) : st->term[t].nib + i;
+            nib_plane[t][i] = DATA_PLANE_C(cb);
+            USE_PLANE(DATA_PLANE_C(cb));
+        }
+    }
+#undef USE_PLANE
+
+    /* Linear planes as slots, so the word loop never looks at bit masks */
+    int lin[DATA_PLANES], nlin = 0;
+    for (int b = 0; b < 64; ++b) {
+        if ((ps->p_bits >> b) & 1) lin[nlin++] = slot[DATA_PLANE_P(b)];
+        if ((ps->c_bits >> b) & 1) lin[nlin++] = slot[DATA_PLANE_C(b)];
+    }
+
+    uint64_t dist[2][16];
+    for (int x = 0; x < 16; ++x) {
+        dist[0][x] = s->tab[0][0][x];
+        dist[1][x] = s->tab[1][0][x];
+    }
+    int64_t chunks = (int64_t)((words + PLANE_CHUNK - 1) / PLANE_CHUNK);
+    int64_t seg = (stop_z > 0 || ck->path) ? STOP_CHECK / (BS_LANES * PLANE_CHUNK) : chunks;
+    uint64_t done_words = start / BS_LANES;
+    int failed = 0, due = 0;
+    double t0 = omp_get_wtime(), last = t0;
+
+#pragma omp parallel
+    {
+        uint64_t ones[16] = { 0 }, all[16] = { 0 };
+        uint64_t* w = malloc(sizeof(uint64_t) * PLANE_CHUNK * np);
+        int64_t c = 0;
+
+        /* Segments of seg chunks; the table is merged after each to be tested or saved */
+        for (int64_t s0 = (int64_t)(start / (BS_LANES * PLANE_CHUNK)); s0 < chunks; s0 += seg) {
+            int64_t s1 = (chunks - s0 < seg) ? chunks : s0 + seg;
+#pragma omp for schedule(dynamic)
+            for (c = s0; c < s1; ++c) {
+                uint64_t first = (uint64_t)c * PLANE_CHUNK;
+                size_t n = (words - first < PLANE_CHUNK) ? (size_t)(words - first) : PLANE_CHUNK;
+
+                int ok = (w != NULL);
+                for (int s = 0; s < np && ok; ++s)
+                    ok = data_source_read_plane(src, planes[s], first, n, w + (size_t)s * PLANE_CHUNK) == n;
+                if (!ok) {
+#pragma omp critical(planes_failed)
+                    failed = 1;
+                    continue;
+                }
+
+                for (size_t j = 0; j < n; ++j) {
+                    uint64_t t = 0, x[4];
+
+                    for (int l = 0; l < nlin; ++l)
+                        t ^= w[(size_t)lin[l] * PLANE_CHUNK + j];
+
+                    /* Fixed‑key S‑box terms */
+                    for (int q = 0; q + 1 < st->nterms; ++q) {
+                        int k = rk[st->term[q].pos], bit = st->term[q].bit;
+                        for (int i = 0; i < 4; ++i)
+                            x[i] = w[(size_t)slot[nib_plane[q][i]] * PLANE_CHUNK + j];
+                        for (int v = 0; v < 16; ++v)
+                            if ((S[v ^ k] >> bit) & 1)
+                                t ^= nibble_is(x, v);
+                    }
+
+                    /* Active nibble: split the 64 lanes by value, never by key guess */
+                    for (int i = 0; i < 4; ++i)
+                        x[i] = w[(size_t)slot[nib_plane[st->nterms - 1][i]] * PLANE_CHUNK + j];
+                    for (int v = 0; v < 16; ++v) {
+                        uint64_t m = nibble_is(x, v);
+                        ones[v] += (uint64_t)bs_popcount64(m & t);
+                        all[v] += (uint64_t)bs_popcount64(m);
+                    }
+                }
+
+#pragma omp atomic
+                done_words += n;
+
+                if (!g_quiet && omp_get_thread_num() == 0 && omp_get_wtime() - last > 0.5) {
+#pragma omp flush(done_words)
+                    uint64_t d = done_words;
+                    last = omp_get_wtime();
+                    double prog = (double)d / words;
+                    double eta = prog ? (last - t0) * (1.0 / prog - 1.0) : 0.0;
+                    printf("\r[Round 0, Stage %d] %.1f%% | %llu/%llu | ETA %.1fs ",
+                        stage, ((int)(prog * 1000)) / 10.0,
+                        (unsigned long long)(d * BS_LANES), (unsigned long long)need, eta);
+                    fflush(stdout);
+                }
+            }
+
+            /* merge only when a test or a save is due, as in scan_pass() */
+            if (seg < chunks) {
+#pragma omp single
+                due = s1 < chunks
+                    && (stop_z > 0 || (ck->path && omp_get_wtime() - ck->saved >= CKPT_SECONDS));
+                if (due) {
+                    for (int v = 0; v < 16; ++v) {
+#pragma omp atomic
+                        dist[1][v] += ones[v];
+#pragma omp atomic
+                        dist[0][v] += all[v] - ones[v];
+                        ones[v] = all[v] = 0;
+                    }
+#pragma omp barrier
+#pragma omp single
+                    {
+                        uint64_t used = (uint64_t)s1 * PLANE_CHUNK * BS_LANES;
+                        if (stop_z > 0) {
+                            double score[MAX_KEYS];
+                            int best;
+                            score_distilled((const uint64_t(*)[16])dist, stage_guess_bit(stage), bucket);
+                            stage_scores(bucket, used, score);
+                            if (stage_settled(score, stop_z, &best)) {
+                                if (!g_quiet)
+                                    printf("\n[Round 0, Stage %d] settled after %llu of %llu pairs\n",
+                                        stage, (unsigned long long)used, (unsigned long long)need);
+                                words = (uint64_t)s1 * PLANE_CHUNK;
+                                chunks = s1;
                             }
                         }
-                        else /* round == 2 */ {
-                            d1 = decrypt_half_one_round(C, right_keys[0]);
-                            d2 = decrypt_half_two_round(C, right_keys[0], right_keys[1]);
-
-                            if (stage == 0) {
-                                t = (P >> 48) & 1;
-                                t ^= (P >> 16) & 1;
-                                t ^= (d1 >> 16) & 1;
-                                t ^= (d2 >> 16) & 1;
-                                t ^= substitute_with_sbox((((d2 >> 15) & 0xE) ^ ((d2 >> 31) & 1)) ^ key) & 1;
-                            }
-                            else if (stage == 1) {
-                                t = (P >> 48) & 1;
-                                t ^= (P >> 16) & 1;
-                                t ^= (d1 >> 18) & 1;
-                                t ^= (d2 >> 16) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 8) & 0xF) ^ key) >> 2) & 1;
-                            }
-                            else if (stage == 2) {
-                                t = (P >> 48) & 1;
-                                t ^= (P >> 16) & 1;
-                                t ^= (d1 >> 18) & 1;
-                                t ^= (d1 >> 31) & 1;
-                                t ^= (d2 >> 16) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 8) & 0xF) ^ right_keys[round][1]) >> 2) & 1;
-                                t ^= substitute_with_sbox(((d2 >> 19) & 0xF) ^ key) & 1;
-                            }
-                            else if (stage == 3) {
-                                t = (P >> 48) & 1;
-                                t ^= (P >> 16) & 1;
-                                t ^= (d1 >> 17) & 1;
-                                t ^= (d1 >> 31) & 1;
-                                t ^= (d2 >> 16) & 1;
-                                t ^= substitute_with_sbox(((d2 >> 19) & 0xF) ^ right_keys[round][5]) & 1;
-                                t ^= substitute_with_sbox(((d2 >> 27) & 0xF) ^ key) & 1;
-                            }
-                            else if (stage == 4) {
-                                t = (P >> 48) & 1;
-                                t ^= (d1 >> 8) & 1;
-                                t ^= (d1 >> 11) & 1;
-                                t ^= (d1 >> 16) & 1;
-                                t ^= (d2 >> 18) & 1;
-                                t ^= substitute_with_sbox((((d2 >> 15) & 0xE) ^ ((d2 >> 31) & 1)) ^ right_keys[round][8]) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 8) & 0xF) ^ right_keys[round][1]) >> 1) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 4) & 0xF) ^ key) >> 1) & 1;
-                            }
-                            else if (stage == 5) {
-                                t = (P >> 48) & 1;
-                                t ^= (d1 >> 9) & 1;
-                                t ^= (d1 >> 11) & 1;
-                                t ^= (d1 >> 16) & 1;
-                                t ^= (d2 >> 18) & 1;
-                                t ^= substitute_with_sbox((((d2 >> 15) & 0xE) ^ ((d2 >> 31) & 1)) ^ right_keys[round][8]) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 8) & 0xF) ^ right_keys[round][1]) >> 1) & 1;
-                                t ^= substitute_with_sbox(((d2 >> 23) & 0xF) ^ key) & 1;
-                            }
-                            else if (stage == 6) {
-                                t = (P >> 48) & 1;
-                                t ^= (d1 >> 16) & 1;
-                                t ^= (d1 >> 19) & 1;
-                                t ^= (d1 >> 21) & 1;
-                                t ^= (d1 >> 27) & 1;
-                                t ^= (d1 >> 29) & 1;
-                                t ^= (d2 >> 17) & 1;
-                                t ^= (d2 >> 31) & 1;
-                                t ^= substitute_with_sbox((((d2 >> 15) & 0xE) ^ ((d2 >> 31) & 1)) ^ right_keys[round][8]) & 1;
-                                t ^= (substitute_with_sbox((((d2 >> 15) & 0xE) ^ ((d2 >> 31) & 1)) ^ right_keys[round][8]) >> 3) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 19) & 0xF) ^ right_keys[round][5]) >> 3) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 4) & 0xF) ^ right_keys[round][4]) >> 2) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 12) & 0xF) ^ key) >> 1) & 1;
-                            }
-                            else if (stage == 7) {
-                                t = (P >> 48) & 1;
-                                t ^= (d1 >> 16) & 1;
-                                t ^= (d1 >> 19) & 1;
-                                t ^= (d1 >> 21) & 1;
-                                t ^= (d1 >> 28) & 1;
-                                t ^= (d2 >> 17) & 1;
-                                t ^= (d2 >> 31) & 1;
-                                t ^= substitute_with_sbox((((d2 >> 15) & 0xE) ^ ((d2 >> 31) & 1)) ^ right_keys[round][8]) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 19) & 0xF) ^ right_keys[round][5]) >> 3) & 1;
-                                t ^= (substitute_with_sbox(((d2 >> 12) & 0xF) ^ right_keys[round][2]) >> 1) & 1;
-                                t ^= (substitute_with_sbox((d2 & 0xF) ^ key) >> 3) & 1;
+                        if (s1 < chunks && !failed && ck->path
+                            && omp_get_wtime() - ck->saved >= CKPT_SECONDS) {
+                            for (int x = 0; x < 16; ++x) {
+                                s->tab[0][0][x] = dist[0][x];
+                                s->tab[1][0][x] = dist[1][x];
                             }
+                            s->used = used;
+                            checkpoint_pass(ck, s, 1, used);
                         }
-
-                        /* Accumulate parity */
-                        local_sum += t;
                     }
+                }
+            }
+        }
+
+        for (int v = 0; v < 16; ++v) {
+#pragma omp atomic
+            dist[1][v] += ones[v];
 #pragma omp atomic
-                    bucket[key_idx] += local_sum;
+            dist[0][v] += all[v] - ones[v];
+        }
+        free(w);
+    }
+
+    if (failed) {
+        /* start over from scratch through the pair path */
+        perror("read plane");
+        return 0;
+    }
+    score_distilled((const uint64_t(*)[16])dist, stage_guess_bit(stage), bucket);
+    return words * BS_LANES;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Linear Cryptanalysis                                                      */
+/* -------------------------------------------------------------------------- */
+/* Tuning of linear_attack_recover_keys() */
+typedef struct {
+    const char* sidecar;    /* dataset to keep large d1 / d2 columns next to, or NULL */
+    int         shift;      /* stages count 2^(stage_exp − shift) pairs              */
+    double      stop_z;     /* early‑stopping threshold (std. deviations), 0 = off   */
+    const char* checkpoint; /* checkpoint file, or NULL                              */
+    int         resume;     /* continue from `checkpoint` if it matches              */
+    uint64_t    mem_max;    /* bytes of one d1 / d2 column kept in memory            */
+} AttackOptions;
+
+/* d1 / d2 column for `round`, sized for its largest stage */
+static void dcol_open_round(DColumn* col, const DataSource* src, int round, const AttackOptions* opt)
+{
+    uint64_t most = 0;
+    for (int stage = 0; stage < 8; ++stage)
+        if (stage_need(round, stage, opt->shift) > most)
+            most = stage_need(round, stage, opt->shift);
+    if (most > src->pairs)
+        most = src->pairs;
+    dcol_open(col, most, opt->mem_max, opt->sidecar, round == 1 ? ".d1" : ".d2");
+}
+
+/*
+ * Besides the top nibbles in rk_nib, rank[][] receives all 16 candidates of
+ * every attacked nibble (the others stay fixed at 0).
+ */
+static void linear_attack_recover_keys(DataSource* src,
+    const AttackOptions* opt,
+    uint8_t rk_nib[3][9],
+    KeyRanking rank[3][9],
+    FILE* logfp)
+{
+    uint8_t right_keys[3][9] = { {0} };
+    DColumn dcol[2];
+    memset(dcol, 0, sizeof(dcol));
+    for (int r = 0; r < 3; ++r)
+        for (int n = 0; n < 9; ++n)
+            key_ranking_fixed(&rank[r][n], 0);
+
+    ScanStage* ss = malloc(sizeof(ScanStage) * SCAN_STAGES);
+    Checkpoint* ck = calloc(1, sizeof(Checkpoint));
+    if (!ss || !ck) {
+        puts("malloc fail");
+        free(ss);
+        free(ck);
+        return;
+    }
+
+    if (!g_quiet)
+        printf("[*] Start Linear Cryptanalysis (%s source, %s reader)\n",
+            data_source_name(src), data_reader_name(src->reader));
+
+    /* Where to start: from scratch, or where the checkpoint left off */
+    int first_round = 0, resume_ns = 0;
+    unsigned first_todo = 0xFF, first_known = 0;
+    uint64_t resume_at = 0;
+    ck->path = opt->checkpoint;
+    if (ck->path && opt->resume && checkpoint_load(ck, src, opt->shift, opt->stop_z)) {
+        first_round = ck->st.round;
+        first_todo = ck->st.todo;
+        first_known = ck->st.known;
+        memcpy(right_keys, ck->st.right_keys, sizeof(right_keys));
+        memcpy(rk_nib, ck->st.right_keys, sizeof(right_keys));
+        memcpy(rank, ck->st.rank, sizeof(ck->st.rank));
+        resume_ns = ck->st.ns;
+        resume_at = ck->st.offset;
+        memcpy(ss, ck->st.ss, sizeof(ScanStage) * (size_t)resume_ns);
+        printf("[*] Resuming from %s: round %d, %d stage(s) left, pass at pair %llu\n",
+            ck->path, first_round, (int)bs_popcount64(first_todo), (unsigned long long)resume_at);
+    }
+    else {
+        if (ck->path && opt->resume)
+            printf("[*] No matching checkpoint in %s, starting over\n", ck->path);
+        ck->st.magic = CKPT_MAGIC;
+        ck->st.version = CKPT_VERSION;
+        ck->st.size = (uint32_t)sizeof(ck->st);
+        ck->st.pairs = src->pairs;
+        ck->st.seed = src->seed;
+        ck->st.key_fp = src->key_fp;
+        ck->st.shift = opt->shift;
+        ck->st.stop_z = opt->stop_z;
+    }
+    ck->saved = omp_get_wtime();
+
+    for (int round = first_round; round < 3; ++round) {
+        unsigned todo = round == first_round ? first_todo : 0xFF;   /* stages still to run      */
+        unsigned known = round == first_round ? first_known : 0;    /* right_keys[round] found  */
+
+        /* in‑pass checkpoints before the round's first stage resolves */
+        ck->st.round = round;
+        ck->st.todo = todo;
+        ck->st.known = known;
+
+        /* d1 from round 1 on, d2 in round 2 */
+        if (round == 1 || (round == 2 && round == first_round))
+            dcol_open_round(&dcol[0], src, round, opt);
+        if (round == 2)
+            dcol_open_round(&dcol[1], src, round, opt);
+
+        while (todo) {
+            int ns;
+            uint64_t start = 0;
+
+            if (round == 0 && src->kind == DATA_SOURCE_FILE && src->format == DATA_FORMAT_PLANES
+                && resume_ns <= 1) {
+                /*
+                 * Round 0 only reads P/C bits: with a plane dataset, count each
+                 * stage straight off the planes it needs, in stage order, or
+                 * go on with the interrupted one.
+                 */
+                if (resume_ns) {
+                    start = resume_at;
+                    resume_ns = 0;
+                }
+                else {
+                    int stage = 0;
+                    while (stage < 7 && !((todo >> stage) & 1))
+                        ++stage;
+                    memset(&ss[0], 0, sizeof(ss[0]));
+                    ss[0].stage = stage;
+                    ss[0].joint = -1;
+                    ss[0].need = stage_need(round, stage, opt->shift);
                 }
-                used += n;
+                uint64_t bucket[MAX_KEYS] = { 0 };
+                uint64_t used = count_round0_planes(src, right_keys[0], &ss[0], start, opt->stop_z, ck, bucket);
+                if (used) {
+                    resolve_stage(round, ss[0].stage, bucket, used, NULL, -1, right_keys, rk_nib, rank);
+                    todo &= ~(1u << ss[0].stage);
+                    known |= 1u << stage_to_pos(ss[0].stage);
+                    checkpoint_stage(ck, round, todo, known, right_keys, rank);
+                    continue;
+                }
+                /* start the stage over through the pair path */
+                memset(ss[0].tab, 0, sizeof(ss[0].tab));
+                ss[0].used = 0;
+                start = 0;
+                ns = 1;
+            }
+            else if (resume_ns) {
+                /* the interrupted pass, with its tables so far */
+                ns = resume_ns;
+                start = resume_at;
+                resume_ns = 0;
+            }
+            else {
+                ns = next_pass(todo, known, round, opt->shift, ss);
+                if (!ns)
+                    break;      /* unreachable: stage 0 depends on nothing */
+            }
 
-                double prog = (double)used / need;
-                double pct = ((int)(prog * 1000)) / 10.0;
-                double eta = prog ? (omp_get_wtime() - t0) * (1.0 / prog - 1.0) : 0.0;
-                printf("\r[Round %d, Stage %d] %.1f%% | %llu/%llu | ETA %.1fs ",
-                    round, stage, pct, (unsigned long long)used, (unsigned long long)need, eta);
-                fflush(stdout);
+            if (!scan_pass(src, round, right_keys, ss, ns, start, opt->stop_z, ck, dcol)) {
+                puts("malloc fail");
+                dcol_close(&dcol[0]);
+                dcol_close(&dcol[1]);
+                free(ss);
+                free(ck);
+                return;
             }
-            puts("");
 
-            /* Pick the nibble with the largest bias */
-            int best = find_max_deviation_index(bucket, used);
-            int pos = stage_to_pos(stage);
-            right_keys[round][pos] = (uint8_t)best;
-            rk_nib[round][pos] = (uint8_t)best;
-            printf("[Round %d, Stage %d] key[%d] = %d\n", round, stage, pos, best);
+            resolve_pass(round, ss, ns, right_keys, rk_nib, rank);
+            for (int j = 0; j < ns; ++j) {
+                todo &= ~(1u << ss[j].stage);
+                known |= 1u << stage_to_pos(ss[j].stage);
+            }
+            checkpoint_stage(ck, round, todo, known, right_keys, rank);
         }
     }
 
-    free(buffer);
-    fclose(fp);
+    dcol_close(&dcol[0]);
+    dcol_close(&dcol[1]);
+    free(ss);
+    free(ck);
 
     /* Optional log output */
     if (logfp) {
@@ -451,15 +1773,345 @@ static void linear_attack_recover_keys(const char* dataset_path,
     }
 }
 
+/* -------------------------------------------------------------------------- */
+/*  Experiments: success rate vs data complexity                              */
+/* -------------------------------------------------------------------------- */
+
+/* Nibbles of a round‑key word: the inverse of convert_key_array_to_uint32() */
+static void split_key_word(uint32_t w, uint8_t nib[9])
+{
+    uint16_t upper = (uint16_t)(w >> 16), lower = (uint16_t)w;
+    upper = (uint16_t)((upper >> 3) | (upper << 13));
+
+    nib[0] = 0;
+    nib[8] = (uint8_t)(upper >> 12);
+    nib[7] = (uint8_t)((upper >> 8) & 0xF);
+    nib[6] = (uint8_t)((upper >> 4) & 0xF);
+    nib[5] = (uint8_t)(upper & 0xF);
+    nib[2] = (uint8_t)(lower >> 12);
+    nib[1] = (uint8_t)((lower >> 8) & 0xF);
+    nib[4] = (uint8_t)((lower >> 4) & 0xF);
+    nib[3] = (uint8_t)(lower & 0xF);
+}
+
+/*
+ * What the attack should recover for ks: C = state ^ rk[19], so the last
+ * three rounds see rk18 ^ K10_R, rk17 ^ K10_L and rk16 ^ K10_R with
+ * K10_L / K10_R the high / low half of rk[19].
+ */
+static void true_round_keys(const KeySchedule* ks, uint8_t nib[3][9])
+{
+    uint32_t k10_l = (uint32_t)(ks->rk[19] >> 32), k10_r = (uint32_t)ks->rk[19];
+    split_key_word((uint32_t)ks->rk[18] ^ k10_r, nib[0]);
+    split_key_word((uint32_t)ks->rk[17] ^ k10_l, nib[1]);
+    split_key_word((uint32_t)ks->rk[16] ^ k10_r, nib[2]);
+}
+
+typedef struct {
+    int     stage_ok[3][8];    /* top nibble right                              */
+    int     stage_rank[3][8];  /* position of the right nibble in its ranking   */
+    int     key_rank;          /* combinations up to the right one, ‑1: > EXP_RANK_MAX */
+    double  seconds;
+} ExpResult;
+
+/* Key schedule of experiment key `index`, from the EXP_SEED stream */
+static void experiment_key(int index, KeySchedule* ks)
+{
+    uint8_t mkey[16];
+    uint64_t hi = generate_plaintext(EXP_SEED, 2 * (uint64_t)index);
+    uint64_t lo = generate_plaintext(EXP_SEED, 2 * (uint64_t)index + 1);
+    for (int i = 0; i < 8; ++i) {
+        mkey[i] = (uint8_t)(hi >> (56 - 8 * i));
+        mkey[8 + i] = (uint8_t)(lo >> (56 - 8 * i));
+    }
+    key_schedule(mkey, ks);
+}
+
+/*
+ * One experiment: key `index` over the DATASET_SEED plaintexts, from the
+ * oracle or from the dataset `data` (NULL: oracle), the attack at 2^‑shift
+ * of the data, then where the right key ended up.  A dataset that cannot be
+ * opened, or is not this key's or too short for the cut, is reported and
+ * replaced by the oracle, which serves the same pairs.  The 2^35 search is not
+ * run; a combination's rank says how many searches it would have taken.
+ */
+static void run_experiment(int index, int shift, const char* data, const AttackOptions* base,
+    ExpResult* res)
+{
+    double t0 = omp_get_wtime();
+    KeySchedule ks;
+    uint8_t truth[3][9];
+    experiment_key(index, &ks);
+    true_round_keys(&ks, truth);
+
+    DataSource src;
+    uint64_t pairs = TARGET_PAIRS >> shift;
+    if (data && data_source_open_file(&src, data, DATA_READER_PREAD)) {
+        if (src.seed != DATASET_SEED || src.key_fp != data_key_fingerprint(&ks) || src.pairs < pairs) {
+            printf("[!] %s: not key %d's dataset of %llu pairs, using the oracle\n",
+                data, index, (unsigned long long)pairs);
+            data_source_close(&src);
+            data = NULL;
+        }
+    }
+    else if (data) {
+        printf("[!] %s: cannot open, using the oracle\n", data);
+        data = NULL;
+    }
+    if (!data)
+        data_source_open_oracle(&src, &ks, DATASET_SEED, pairs);
+
+    AttackOptions opt = *base;
+    opt.sidecar = NULL;
+    opt.shift = shift;
+    opt.checkpoint = NULL;
+    opt.resume = 0;
+    uint8_t rk_nib[3][9] = { {0} };
+    KeyRanking rank[3][9];
+    linear_attack_recover_keys(&src, &opt, rk_nib, rank, NULL);
+    data_source_close(&src);
+
+    for (int r = 0; r < 3; ++r) {
+        for (int stage = 0; stage < 8; ++stage) {
+            int pos = stage_to_pos(stage), i = 0;
+            while (i < rank[r][pos].n - 1 && rank[r][pos].value[i] != truth[r][pos])
+                ++i;
+            res->stage_ok[r][stage] = rk_nib[r][pos] == truth[r][pos];
+            res->stage_rank[r][stage] = i;
+        }
+    }
+
+    res->key_rank = -1;
+    KeyEnum* ke = key_enum_start(&rank[0][0], 3 * 9);
+    uint8_t nib[3 * 9];
+    double score;
+    int more = ke ? 1 : -1;
+    for (int n = 0; more > 0 && n < EXP_RANK_MAX && (more = key_enum_next(ke, nib, &score)) > 0; ++n) {
+        if (memcmp(nib, truth, sizeof(nib)) == 0) {
+            res->key_rank = n;
+            break;
+        }
+    }
+    if (more < 0)
+        printf("[!] key %d: out of memory ranking the round keys\n", index);
+    key_enum_stop(ke);
+    res->seconds = omp_get_wtime() - t0;
+}
+
+/* "4,6,8" → shifts[]; returns their number, 0 if the list is malformed */
+static int parse_shifts(const char* list, int shifts[EXP_MAX_SHIFT + 1])
+{
+    int n = 0;
+    while (*list) {
+        char* end;
+        long v = strtol(list, &end, 10);
+        if (end == list || v < 0 || v > EXP_MAX_SHIFT || n > EXP_MAX_SHIFT)
+            return 0;
+        shifts[n++] = (int)v;
+        if (*end == ',')
+            ++end;
+        else if (*end)
+            return 0;
+        list = end;
+    }
+    return n;
+}
+
+/*
+ * Runs nkeys random master keys at each data cut in shifts[], experiments
+ * in parallel (one per thread, the attack inside runs single‑threaded), and
+ * reports per data size the success rate and mean right‑nibble rank of
+ * every stage, the rank of the right round‑key combination and wall time.
+ * Each concurrent experiment keeps its d1 / d2 columns in memory only up to
+ * its share of DCOL_MEM_MAX; a larger column is recomputed on every pass.
+ * With `dir`, the keys' datasets (in `format`, sized for the largest cut)
+ * are first written there in one multi‑key pass and the attacks read them
+ * instead of regenerating pairs on every scan.
+ */
+static void run_experiments(int nkeys, const int* shifts, int nshifts, int budget,
+    const char* dir, int format, const AttackOptions* base)
+{
+    int total = nkeys * nshifts, finished = 0;
+    ExpResult* res = calloc((size_t)total, sizeof(ExpResult));
+    char (*path)[DATA_PATH_MAX] = dir ? calloc((size_t)nkeys, DATA_PATH_MAX) : NULL;
+    if (!res || (dir && !path)) {
+        puts("malloc fail");
+        free(res);
+        free(path);
+        return;
+    }
+
+    if (dir) {
+        KeySchedule* ks = malloc(sizeof(KeySchedule) * (size_t)nkeys);
+        const char** paths = malloc(sizeof(char*) * (size_t)nkeys);
+        int least = shifts[0], ok = ks && paths;
+        for (int s = 1; s < nshifts; ++s)
+            if (shifts[s] < least)
+                least = shifts[s];
+        for (int k = 0; k < nkeys && ok; ++k) {
+            experiment_key(k, &ks[k]);
+            snprintf(path[k], DATA_PATH_MAX, "%s/exp_%04d.bin", dir, k);
+            paths[k] = path[k];
+        }
+        if (ok)
+            ok = generate_datasets(ks, nkeys, DATASET_SEED, TARGET_PAIRS >> least, paths, format);
+        free(ks);
+        free(paths);
+        if (!ok) {
+            puts("[EXP] datasets not written, using the oracle");
+            free(path);
+            path = NULL;
+        }
+    }
+
+    printf("[EXP] %d key(s) x %d data size(s) on %d threads\n", nkeys, nshifts, omp_get_max_threads());
+    g_quiet = 1;
+    AttackOptions eo = *base;
+    eo.mem_max = DCOL_MEM_MAX / (2 * (uint64_t)omp_get_max_threads());
+#if _OPENMP >= 200805
+    omp_set_max_active_levels(1);
+#else
+    omp_set_nested(0);
+#endif
+    double t0 = omp_get_wtime();
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int e = 0; e < total; ++e) {
+        run_experiment(e % nkeys, shifts[e / nkeys], path ? path[e % nkeys] : NULL, &eo, &res[e]);
+
+        int ok = 0;
+        for (int r = 0; r < 3; ++r)
+            for (int stage = 0; stage < 8; ++stage)
+                ok += res[e].stage_ok[r][stage];
+#pragma omp critical(exp_report)
+        {
+            ++finished;
+            printf("[EXP] %d/%d: key %d, 2^-%d data: %2d/24 stages, key rank %d, %.1fs\n",
+                finished, total, e % nkeys, shifts[e / nkeys], ok, res[e].key_rank, res[e].seconds);
+            fflush(stdout);
+        }
+    }
+    g_quiet = 0;
+
+    for (int s = 0; s < nshifts; ++s) {
+        const ExpResult* r0 = &res[s * nkeys];
+        int found = 0;
+        double secs = 0.0;
+
+        printf("\n[EXP] 2^-%d of stage_exp, %d key(s)\n", shifts[s], nkeys);
+        puts("Round  Stage  Pairs      Success  MeanRank");
+        for (int r = 0; r < 3; ++r) {
+            for (int stage = 0; stage < 8; ++stage) {
+                int ok = 0;
+                double mean = 0.0;
+                for (int k = 0; k < nkeys; ++k) {
+                    ok += r0[k].stage_ok[r][stage];
+                    mean += r0[k].stage_rank[r][stage];
+                }
+                printf("R%-5d %-6d 2^%-7d %6.1f%%  %8.2f\n", 18 - r, stage,
+                    stage_exp[r][stage] - shifts[s], 100.0 * ok / nkeys, mean / nkeys);
+            }
+        }
+        for (int k = 0; k < nkeys; ++k) {
+            found += r0[k].key_rank >= 0 && r0[k].key_rank < budget;
+            secs += r0[k].seconds;
+        }
+        printf("Round keys within budget %d: %d/%d (%.1f%%), mean wall time %.1fs\n",
+            budget, found, nkeys, 100.0 * found / nkeys, secs / nkeys);
+    }
+    printf("\n[EXP] done in %.1fs\n", omp_get_wtime() - t0);
+    free(path);
+    free(res);
+}
+
 /* -------------------------------------------------------------------------- */
 /*  Main                                                                      */
 /* -------------------------------------------------------------------------- */
-int main(void)
+int main(int argc, char** argv)
 {
     omp_set_num_threads(MAX_THREADS);
 
+    /*
+     * --oracle          regenerate pairs on demand instead of writing/reading DATA_BIN
+     * --format=<name>   DATA_BIN encoding: pair (default), packed, ct or planes
+     * --reader=<name>   how the attack reads DATA_BIN: pread (default), mmap or async
+     * --stripe=<dirs>   stripe DATA_BIN's records over files in these comma‑separated
+     *                   directories, one per disk (not with --format=planes)
+     * --budget=<n>      search at most n round‑key combinations, most likely first
+     * --data-shift=<s>  count 2^s times fewer pairs per stage (0…MAX_DATA_SHIFT)
+     * --early-stop=<z>  end a stage once its leading guess beats the runner‑up
+     *                   by z² in log‑likelihood, about z standard deviations
+     *                   (tested every STOP_CHECK pairs)
+     * --checkpoint=<f>  where the attack state is saved (default CKPT_FILE)
+     * --resume          continue from the checkpoint of an interrupted run
+     * --experiment[=n]  instead of the demo: attack n random keys (default TOTAL_KEYS)
+     *                   on oracle data at each --exp-shifts cut, concurrently, and
+     *                   report per‑stage success rates, key ranks and wall times
+     * --exp-shifts=<l>  comma‑separated data cuts 2^‑s of stage_exp (default EXP_SHIFTS)
+     * --exp-data=<dir>  write the experiment datasets (--format) to dir in one
+     *                   multi‑key pass and attack those instead of the oracle
+     */
     const char* DATA_BIN = "E:/wonwoo/pt_ct_tmp.bin"; /* Output file for plaintext‑ciphertext pairs */
     const char* LOG_FILE = "E:/wonwoo/keys.txt";     /* Log for recovered subkeys & master key */
+    const char* CKPT_FILE = "E:/wonwoo/attack.ckpt"; /* Attack state after every stage */
+    int use_oracle = 0;
+    int format = DATA_FORMAT_PAIR;
+    int reader = DATA_READER_PREAD;
+    DataStripes stripes = { 0 };
+    int budget = KEY_BUDGET;
+    AttackOptions opt = { NULL, 0, 0.0, NULL, 0, DCOL_MEM_MAX };
+    opt.checkpoint = CKPT_FILE;
+    int experiments = 0;
+    const char* exp_list = EXP_SHIFTS;
+    const char* exp_dir = NULL;
+    for (int a = 1; a < argc; ++a) {
+        if (strcmp(argv[a], "--oracle") == 0)
+            use_oracle = 1;
+        else if (strncmp(argv[a], "--format=", 9) == 0 && data_format_parse(argv[a] + 9) >= 0)
+            format = data_format_parse(argv[a] + 9);
+        else if (strncmp(argv[a], "--reader=", 9) == 0 && data_reader_parse(argv[a] + 9) >= 0)
+            reader = data_reader_parse(argv[a] + 9);
+        else if (strncmp(argv[a], "--stripe=", 9) == 0 && data_stripes_init(&stripes, DATA_BIN, argv[a] + 9, STRIPE_PAIRS))
+            continue;
+        else if (strncmp(argv[a], "--budget=", 9) == 0 && atoi(argv[a] + 9) > 0)
+            budget = atoi(argv[a] + 9);
+        else if (strncmp(argv[a], "--data-shift=", 13) == 0
+            && atoi(argv[a] + 13) >= 0 && atoi(argv[a] + 13) <= MAX_DATA_SHIFT)
+            opt.shift = atoi(argv[a] + 13);
+        else if (strncmp(argv[a], "--early-stop=", 13) == 0 && atof(argv[a] + 13) > 0)
+            opt.stop_z = atof(argv[a] + 13);
+        else if (strncmp(argv[a], "--checkpoint=", 13) == 0 && argv[a][13])
+            opt.checkpoint = argv[a] + 13;
+        else if (strcmp(argv[a], "--resume") == 0)
+            opt.resume = 1;
+        else if (strcmp(argv[a], "--experiment") == 0)
+            experiments = TOTAL_KEYS;
+        else if (strncmp(argv[a], "--experiment=", 13) == 0 && atoi(argv[a] + 13) > 0)
+            experiments = atoi(argv[a] + 13);
+        else if (strncmp(argv[a], "--exp-shifts=", 13) == 0 && argv[a][13])
+            exp_list = argv[a] + 13;
+        else if (strncmp(argv[a], "--exp-data=", 11) == 0 && argv[a][11])
+            exp_dir = argv[a] + 11;
+        else {
+            fprintf(stderr, "usage: %s [--oracle] [--format=pair|packed|ct|planes] [--reader=pread|mmap|async]"
+                " [--stripe=dir,dir,...] [--budget=n] [--data-shift=0..%d] [--early-stop=z]"
+                " [--checkpoint=file] [--resume] [--experiment[=n]] [--exp-shifts=s,s,...]"
+                " [--exp-data=dir]\n",
+                argv[0], MAX_DATA_SHIFT);
+            return 1;
+        }
+    }
+    if (stripes.count && format == DATA_FORMAT_PLANES) {
+        fprintf(stderr, "--stripe does not apply to --format=planes\n");
+        return 1;
+    }
+    int exp_shift[EXP_MAX_SHIFT + 1];
+    int exp_nshifts = parse_shifts(exp_list, exp_shift);
+    if (experiments && !exp_nshifts) {
+        fprintf(stderr, "--exp-shifts takes values 0..%d\n", EXP_MAX_SHIFT);
+        return 1;
+    }
+
     FILE* logfp = fopen(LOG_FILE, "a");
     if (!logfp) {
         perror("log file");
@@ -475,12 +2127,41 @@ int main(void)
     KeySchedule ks;
     key_schedule(mkey, &ks);
 
-    /* (1) Generate 2^33 known (P,C) pairs */
-    generate_dataset(&ks, DATA_BIN, TARGET_PAIRS);
+    /* Cross‑check the bitsliced engine against the T‑table encrypt() */
+    if (!bs_self_test(&ks, 1ULL << 16)) {
+        puts("[!] bitsliced engine disagrees with encrypt()");
+        return 1;
+    }
+    if (!batch_self_test(&ks, 1 << 16))
+        return 1;
+    printf("[*] batch kernel: %s\n", batch_kernel_name());
+
+    if (experiments) {
+        run_experiments(experiments, exp_shift, exp_nshifts, budget, exp_dir, format, &opt);
+        fclose(logfp);
+        return 0;
+    }
+
+    /* (1) 2^33 known (P,C) pairs: written to DATA_BIN, or kept virtual in oracle mode */
+    DataSource src;
+    data_source_open_oracle(&src, &ks, DATASET_SEED, TARGET_PAIRS);
+    if (!use_oracle) {
+        generate_dataset(&src, DATA_BIN, format, &stripes);
+        data_source_close(&src);
+        if (!data_source_open_file(&src, DATA_BIN, reader)) {
+            perror("open dataset");
+            return 1;
+        }
+        if (src.reader != reader)
+            printf("[*] %s reader unavailable for this dataset, using %s\n",
+                data_reader_name(reader), data_reader_name(src.reader));
+    }
 
     /* (2) Linear attack to recover the last three round keys as 9‑nibble arrays */
     uint8_t rk_nib[3][9] = { {0} };
-    linear_attack_recover_keys(DATA_BIN, rk_nib, logfp);
+    KeyRanking rank[3][9];
+    opt.sidecar = use_oracle ? NULL : DATA_BIN;
+    linear_attack_recover_keys(&src, &opt, rk_nib, rank, logfp);
 
     /* (3) Convert nibbles → 32‑bit words */
     uint32_t rk32[3];
@@ -491,12 +2172,39 @@ int main(void)
 
     /* (4) Master‑key recovery using two (P,C) pairs and RK16 xor K10_R,RK17 xor K10_L,RK18 xor K10_R */
     Pair two[2];
-    FILE* fp = fopen(DATA_BIN, "rb");
-    fread(two, sizeof(Pair), 2, fp);
-    fclose(fp);
+    data_source_read(&src, 0, 2, two);
+    if (src.kind == DATA_SOURCE_FILE && src.format == DATA_FORMAT_PACKED) {
+        /* packed pairs keep only P bits 16/48; the full plaintexts come from the seed */
+        two[0].plaintext = generate_plaintext(src.seed, 0);
+        two[1].plaintext = generate_plaintext(src.seed, 1);
+    }
+    data_source_close(&src);
 
-    uint8_t rec[16];
-    if (!find_master_key(two, rk32[2], rk32[1], rk32[0], rec))
+    /*
+     * (5) The 2^35 search per round‑key combination, in descending likelihood:
+     * the first combination is the top nibble of every stage, as above
+     */
+    uint8_t rec[16] = { 0 };
+    int found = 0, tried = 0;
+    KeyEnum* ke = key_enum_start(&rank[0][0], 3 * 9);
+    uint8_t nib[3 * 9];
+    double score;
+    int more = ke ? 1 : -1;
+    while (more > 0 && !found && tried < budget && (more = key_enum_next(ke, nib, &score)) > 0) {
+        uint32_t w[3];
+        for (int r = 0; r < 3; ++r)
+            w[r] = convert_key_array_to_uint32(&nib[9 * r]);
+        printf("\n[Key] combination %d (log-likelihood %.1f): R18 %08X R17 %08X R16 %08X\n",
+            ++tried, score, w[0], w[1], w[2]);
+        found = find_master_key(two, w[2], w[1], w[0], rec);
+    }
+    key_enum_stop(ke);
+    if (more < 0) {
+        puts("\n[!] out of memory enumerating round-key combinations");
+        fprintf(logfp, "[Key] out of memory enumerating round-key combinations\n");
+    }
+    fprintf(logfp, "[Key] %d round-key combination(s) searched\n", tried);
+    if (!found)
         fprintf(logfp, "[Key] master‑key recovery FAILED\n\n");
 
     fprintf(logfp, "Recovered : ");
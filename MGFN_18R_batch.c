@@ -0,0 +1,489 @@
+﻿/*-----------------------------------------------------------------------------
+ * MGFN_18R_batch.c — batch APIs for Table_lookup, encrypt and decrypt_half_*
+ * ---------------------------------------------------------------------------
+ * The hot loops of the attack call the one‑element routines of MGFN_18R.c
+ * through cross‑TU calls.  The functions here take whole arrays and pick,
+ * once per process, the fastest kernel the CPU supports:
+ *
+ *   scalar  — table_lookup32() from MGFN_18R.h, portable fallback
+ *   avx2    — 8 lanes, the four byte tables te1..te4 via vpgatherdd
+ *   avx512  — 16 lanes; F is split into eight 16‑entry tables (one per S‑box,
+ *             output already permuted) so each lookup is a single vpermd
+ *
+ * The AVX‑512 tables are derived from Table_lookup itself at start‑up: since
+ * S[3] = 0, feeding 3 into every other nibble isolates one S‑box.
+ *----------------------------------------------------------------------------*/
+
+#include "MGFN_18R_batch.h"
+#include <string.h>
+#include <omp.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define BATCH_HAVE_X86        1
+#define BATCH_TARGET_AVX2
+#define BATCH_TARGET_AVX512
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BATCH_HAVE_X86        1
+#define BATCH_TARGET_AVX2     __attribute__((target("avx2")))
+#define BATCH_TARGET_AVX512   __attribute__((target("avx512f")))
+#else
+#define BATCH_HAVE_X86        0
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*  Scalar kernel                                                             */
+/* -------------------------------------------------------------------------- */
+
+static void table_lookup_scalar(const uint32_t* in, size_t n, uint32_t* out)
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = table_lookup32(in[i]);
+}
+
+static inline uint64_t encrypt_scalar1(uint64_t p, const KeySchedule* ks)
+{
+    uint32_t h = (uint32_t)((p ^ ks->rk[0]) >> 32);
+    uint32_t l = (uint32_t)(p ^ ks->rk[0]);
+
+    for (int r = 1; r <= 18; ++r) {
+        uint32_t t = table_lookup32(h ^ (uint32_t)ks->rk[r]) ^ l;
+        l = h;
+        h = t;
+    }
+    return (((uint64_t)h << 32) | l) ^ ks->rk[19];
+}
+
+static void encrypt_scalar(const uint64_t* pt, size_t n, const KeySchedule* ks, uint64_t* ct)
+{
+    for (size_t i = 0; i < n; ++i)
+        ct[i] = encrypt_scalar1(pt[i], ks);
+}
+
+static void decrypt_half_scalar(const uint64_t* ct, size_t n, uint32_t rk24, uint32_t rk23,
+    uint32_t* d1, uint32_t* d2)
+{
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t ch = (uint32_t)(ct[i] >> 32), cl = (uint32_t)ct[i];
+        uint32_t v1 = table_lookup32(cl ^ rk24) ^ ch;
+        d1[i] = v1;
+        if (d2)
+            d2[i] = table_lookup32(v1 ^ rk23) ^ cl;
+    }
+}
+
+#if BATCH_HAVE_X86
+/* -------------------------------------------------------------------------- */
+/*  AVX2 kernel (8 lanes, gathers)                                            */
+/* -------------------------------------------------------------------------- */
+
+BATCH_TARGET_AVX2
+static inline __m256i tl_avx2(__m256i x)
+{
+    const __m256i m8 = _mm256_set1_epi32(0xFF);
+    __m256i b1 = _mm256_or_si256(
+        _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(0x7)), 5),
+        _mm256_srli_epi32(x, 27));
+    __m256i b2 = _mm256_and_si256(_mm256_srli_epi32(x, 19), m8);
+    __m256i b3 = _mm256_and_si256(x, m8);
+    __m256i b4 = _mm256_and_si256(_mm256_srli_epi32(x, 8), m8);
+
+    __m256i r = _mm256_i32gather_epi32((const int*)te1, b1, 4);
+    r = _mm256_xor_si256(r, _mm256_i32gather_epi32((const int*)te2, b2, 4));
+    r = _mm256_xor_si256(r, _mm256_i32gather_epi32((const int*)te3, b3, 4));
+    return _mm256_xor_si256(r, _mm256_i32gather_epi32((const int*)te4, b4, 4));
+}
+
+/* 8 consecutive uint64 → high / low 32‑bit halves, and back */
+BATCH_TARGET_AVX2
+static inline void split_avx2(const uint64_t* p, __m256i* hi, __m256i* lo)
+{
+    __m256i a = _mm256_loadu_si256((const __m256i*)p);
+    __m256i b = _mm256_loadu_si256((const __m256i*)(p + 4));
+    __m256 ta = _mm256_castsi256_ps(_mm256_permute2x128_si256(a, b, 0x20));
+    __m256 tb = _mm256_castsi256_ps(_mm256_permute2x128_si256(a, b, 0x31));
+    *lo = _mm256_castps_si256(_mm256_shuffle_ps(ta, tb, _MM_SHUFFLE(2, 0, 2, 0)));
+    *hi = _mm256_castps_si256(_mm256_shuffle_ps(ta, tb, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+BATCH_TARGET_AVX2
+static inline void join_avx2(__m256i hi, __m256i lo, uint64_t* p)
+{
+    __m256i ulo = _mm256_unpacklo_epi32(lo, hi);
+    __m256i uhi = _mm256_unpackhi_epi32(lo, hi);
+    _mm256_storeu_si256((__m256i*)p, _mm256_permute2x128_si256(ulo, uhi, 0x20));
+    _mm256_storeu_si256((__m256i*)(p + 4), _mm256_permute2x128_si256(ulo, uhi, 0x31));
+}
+
+BATCH_TARGET_AVX2
+static void table_lookup_avx2(const uint32_t* in, size_t n, uint32_t* out)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+        _mm256_storeu_si256((__m256i*)(out + i), tl_avx2(x));
+    }
+    table_lookup_scalar(in + i, n - i, out + i);
+}
+
+BATCH_TARGET_AVX2
+static void encrypt_avx2(const uint64_t* pt, size_t n, const KeySchedule* ks, uint64_t* ct)
+{
+    const __m256i k0h = _mm256_set1_epi32((int)(uint32_t)(ks->rk[0] >> 32));
+    const __m256i k0l = _mm256_set1_epi32((int)(uint32_t)ks->rk[0]);
+    const __m256i k19h = _mm256_set1_epi32((int)(uint32_t)(ks->rk[19] >> 32));
+    const __m256i k19l = _mm256_set1_epi32((int)(uint32_t)ks->rk[19]);
+    __m256i rk[19];
+    for (int r = 1; r <= 18; ++r)
+        rk[r] = _mm256_set1_epi32((int)(uint32_t)ks->rk[r]);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i h, l;
+        split_avx2(pt + i, &h, &l);
+        h = _mm256_xor_si256(h, k0h);
+        l = _mm256_xor_si256(l, k0l);
+        for (int r = 1; r <= 18; ++r) {
+            __m256i t = _mm256_xor_si256(tl_avx2(_mm256_xor_si256(h, rk[r])), l);
+            l = h;
+            h = t;
+        }
+        join_avx2(_mm256_xor_si256(h, k19h), _mm256_xor_si256(l, k19l), ct + i);
+    }
+    encrypt_scalar(pt + i, n - i, ks, ct + i);
+}
+
+BATCH_TARGET_AVX2
+static void decrypt_half_avx2(const uint64_t* ct, size_t n, uint32_t rk24, uint32_t rk23,
+    uint32_t* d1, uint32_t* d2)
+{
+    const __m256i k24 = _mm256_set1_epi32((int)rk24);
+    const __m256i k23 = _mm256_set1_epi32((int)rk23);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i ch, cl;
+        split_avx2(ct + i, &ch, &cl);
+        __m256i v1 = _mm256_xor_si256(tl_avx2(_mm256_xor_si256(cl, k24)), ch);
+        _mm256_storeu_si256((__m256i*)(d1 + i), v1);
+        if (d2) {
+            __m256i v2 = _mm256_xor_si256(tl_avx2(_mm256_xor_si256(v1, k23)), cl);
+            _mm256_storeu_si256((__m256i*)(d2 + i), v2);
+        }
+    }
+    decrypt_half_scalar(ct + i, n - i, rk24, rk23, d1 + i, d2 ? d2 + i : NULL);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  AVX‑512 kernel (16 lanes, in‑register permutes)                           */
+/* -------------------------------------------------------------------------- */
+
+/* g_nib[j][v] = F contribution of S‑box j when its input nibble is v */
+static uint32_t g_nib[8][16];
+
+static uint32_t nibble_to_input(int j, uint32_t v)
+{
+    switch (j) {
+    case 4:  return ((v & 1) << 31) | ((v >> 1) << 16);   /* bits 31,16,17,18 */
+    case 5:  return v << 19;
+    case 6:  return v << 23;
+    case 7:  return v << 27;
+    default: return v << (4 * j);                          /* j = 0..3 */
+    }
+}
+
+static void build_nibble_tables(void)
+{
+    for (int j = 0; j < 8; ++j) {
+        /* every other S‑box gets input 3, whose S‑box output is 0 */
+        uint32_t base = 0;
+        for (int k = 0; k < 8; ++k)
+            if (k != j)
+                base |= nibble_to_input(k, 0x3);
+        for (uint32_t v = 0; v < 16; ++v)
+            g_nib[j][v] = table_lookup32(base | nibble_to_input(j, v));
+    }
+}
+
+typedef struct {
+    __m512i t[8];
+} NibbleTables512;
+
+BATCH_TARGET_AVX512
+static inline void load_nibble_tables(NibbleTables512* nt)
+{
+    for (int j = 0; j < 8; ++j)
+        nt->t[j] = _mm512_loadu_si512((const void*)g_nib[j]);
+}
+
+/* vpermd only looks at the low 4 index bits, so most nibbles need no mask */
+BATCH_TARGET_AVX512
+static inline __m512i tl_avx512(__m512i x, const NibbleTables512* nt)
+{
+    __m512i n4 = _mm512_or_si512(
+        _mm512_and_si512(_mm512_srli_epi32(x, 15), _mm512_set1_epi32(0xE)),
+        _mm512_srli_epi32(x, 31));
+
+    __m512i r = _mm512_permutexvar_epi32(x, nt->t[0]);
+    r = _mm512_xor_si512(r, _mm512_permutexvar_epi32(_mm512_srli_epi32(x, 4), nt->t[1]));
+    r = _mm512_xor_si512(r, _mm512_permutexvar_epi32(_mm512_srli_epi32(x, 8), nt->t[2]));
+    r = _mm512_xor_si512(r, _mm512_permutexvar_epi32(_mm512_srli_epi32(x, 12), nt->t[3]));
+    r = _mm512_xor_si512(r, _mm512_permutexvar_epi32(n4, nt->t[4]));
+    r = _mm512_xor_si512(r, _mm512_permutexvar_epi32(_mm512_srli_epi32(x, 19), nt->t[5]));
+    r = _mm512_xor_si512(r, _mm512_permutexvar_epi32(_mm512_srli_epi32(x, 23), nt->t[6]));
+    return _mm512_xor_si512(r, _mm512_permutexvar_epi32(_mm512_srli_epi32(x, 27), nt->t[7]));
+}
+
+BATCH_TARGET_AVX512
+static inline void split_avx512(const uint64_t* p, __m512i* hi, __m512i* lo)
+{
+    __m512i a = _mm512_loadu_si512((const void*)p);
+    __m512i b = _mm512_loadu_si512((const void*)(p + 8));
+    *lo = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(a)),
+        _mm512_cvtepi64_epi32(b), 1);
+    *hi = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(_mm512_srli_epi64(a, 32))),
+        _mm512_cvtepi64_epi32(_mm512_srli_epi64(b, 32)), 1);
+}
+
+BATCH_TARGET_AVX512
+static inline void join_avx512(__m512i hi, __m512i lo, uint64_t* p)
+{
+    for (int half = 0; half < 2; ++half) {
+        __m256i h = _mm512_extracti64x4_epi64(hi, half);
+        __m256i l = _mm512_extracti64x4_epi64(lo, half);
+        __m512i v = _mm512_or_si512(_mm512_cvtepu32_epi64(l),
+            _mm512_slli_epi64(_mm512_cvtepu32_epi64(h), 32));
+        _mm512_storeu_si512((void*)(p + 8 * half), v);
+    }
+}
+
+BATCH_TARGET_AVX512
+static void table_lookup_avx512(const uint32_t* in, size_t n, uint32_t* out)
+{
+    NibbleTables512 nt;
+    load_nibble_tables(&nt);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_loadu_si512((const void*)(in + i));
+        _mm512_storeu_si512((void*)(out + i), tl_avx512(x, &nt));
+    }
+    table_lookup_scalar(in + i, n - i, out + i);
+}
+
+BATCH_TARGET_AVX512
+static void encrypt_avx512(const uint64_t* pt, size_t n, const KeySchedule* ks, uint64_t* ct)
+{
+    NibbleTables512 nt;
+    load_nibble_tables(&nt);
+
+    const __m512i k0h = _mm512_set1_epi32((int)(uint32_t)(ks->rk[0] >> 32));
+    const __m512i k0l = _mm512_set1_epi32((int)(uint32_t)ks->rk[0]);
+    const __m512i k19h = _mm512_set1_epi32((int)(uint32_t)(ks->rk[19] >> 32));
+    const __m512i k19l = _mm512_set1_epi32((int)(uint32_t)ks->rk[19]);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i h, l;
+        split_avx512(pt + i, &h, &l);
+        h = _mm512_xor_si512(h, k0h);
+        l = _mm512_xor_si512(l, k0l);
+        for (int r = 1; r <= 18; ++r) {
+            __m512i k = _mm512_set1_epi32((int)(uint32_t)ks->rk[r]);
+            __m512i t = _mm512_xor_si512(tl_avx512(_mm512_xor_si512(h, k), &nt), l);
+            l = h;
+            h = t;
+        }
+        join_avx512(_mm512_xor_si512(h, k19h), _mm512_xor_si512(l, k19l), ct + i);
+    }
+    encrypt_scalar(pt + i, n - i, ks, ct + i);
+}
+
+BATCH_TARGET_AVX512
+static void decrypt_half_avx512(const uint64_t* ct, size_t n, uint32_t rk24, uint32_t rk23,
+    uint32_t* d1, uint32_t* d2)
+{
+    NibbleTables512 nt;
+    load_nibble_tables(&nt);
+
+    const __m512i k24 = _mm512_set1_epi32((int)rk24);
+    const __m512i k23 = _mm512_set1_epi32((int)rk23);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i ch, cl;
+        split_avx512(ct + i, &ch, &cl);
+        __m512i v1 = _mm512_xor_si512(tl_avx512(_mm512_xor_si512(cl, k24), &nt), ch);
+        _mm512_storeu_si512((void*)(d1 + i), v1);
+        if (d2) {
+            __m512i v2 = _mm512_xor_si512(tl_avx512(_mm512_xor_si512(v1, k23), &nt), cl);
+            _mm512_storeu_si512((void*)(d2 + i), v2);
+        }
+    }
+    decrypt_half_scalar(ct + i, n - i, rk24, rk23, d1 + i, d2 ? d2 + i : NULL);
+}
+#endif /* BATCH_HAVE_X86 */
+
+/* -------------------------------------------------------------------------- */
+/*  Runtime dispatch                                                          */
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+    const char* name;
+    void (*table_lookup)(const uint32_t*, size_t, uint32_t*);
+    void (*encrypt)(const uint64_t*, size_t, const KeySchedule*, uint64_t*);
+    void (*decrypt_half)(const uint64_t*, size_t, uint32_t, uint32_t, uint32_t*, uint32_t*);
+} BatchKernels;
+
+static const BatchKernels g_kernels[] = {
+    { "scalar", table_lookup_scalar, encrypt_scalar, decrypt_half_scalar },
+#if BATCH_HAVE_X86
+    { "avx2",   table_lookup_avx2,   encrypt_avx2,   decrypt_half_avx2   },
+    { "avx512", table_lookup_avx512, encrypt_avx512, decrypt_half_avx512 },
+#endif
+};
+
+static volatile int g_cpu_level = -1;
+static volatile int g_level = -1;
+
+static int detect_cpu_level(void)
+{
+#if BATCH_HAVE_X86 && defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7)
+        return BATCH_KERNEL_SCALAR;
+    __cpuid(r, 1);
+    if (!(r[2] & (1 << 27)))                 /* OSXSAVE */
+        return BATCH_KERNEL_SCALAR;
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(r, 7, 0);
+    if ((r[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6)
+        return BATCH_KERNEL_AVX512;
+    if ((r[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6)
+        return BATCH_KERNEL_AVX2;
+    return BATCH_KERNEL_SCALAR;
+#elif BATCH_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return BATCH_KERNEL_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return BATCH_KERNEL_AVX2;
+    return BATCH_KERNEL_SCALAR;
+#else
+    return BATCH_KERNEL_SCALAR;
+#endif
+}
+
+static const BatchKernels* batch_kernels(void)
+{
+    if (g_level < 0) {
+#pragma omp critical (batch_dispatch)
+        if (g_level < 0) {
+#if BATCH_HAVE_X86
+            build_nibble_tables();
+#endif
+            g_cpu_level = detect_cpu_level();
+            g_level = g_cpu_level;
+        }
+    }
+    return &g_kernels[g_level];
+}
+
+int batch_cpu_level(void)
+{
+    batch_kernels();
+    return g_cpu_level;
+}
+
+int batch_set_kernel(int level)
+{
+    int cpu = batch_cpu_level();
+    if (level < BATCH_KERNEL_SCALAR)
+        level = BATCH_KERNEL_SCALAR;
+    g_level = level < cpu ? level : cpu;
+    return g_level;
+}
+
+const char* batch_kernel_name(void)
+{
+    return batch_kernels()->name;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Public API                                                                */
+/* -------------------------------------------------------------------------- */
+
+void table_lookup_batch(const uint32_t* in, size_t n, uint32_t* out)
+{
+    batch_kernels()->table_lookup(in, n, out);
+}
+
+void encrypt_batch(const uint64_t* pt, size_t n, const KeySchedule* ks, uint64_t* ct)
+{
+    batch_kernels()->encrypt(pt, n, ks, ct);
+}
+
+void decrypt_half_batch(const uint64_t* ct, size_t n, uint32_t rk24, uint32_t rk23,
+    uint32_t* d1, uint32_t* d2)
+{
+    batch_kernels()->decrypt_half(ct, n, rk24, rk23, d1, d2);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Cross‑check against MGFN_18R.c                                            */
+/* -------------------------------------------------------------------------- */
+
+int batch_self_test(const KeySchedule* ks, size_t n)
+{
+    uint64_t* v = malloc(n * sizeof(uint64_t));
+    uint64_t* c = malloc(n * sizeof(uint64_t));
+    uint32_t* x = malloc(n * sizeof(uint32_t));
+    uint32_t* y = malloc(n * sizeof(uint32_t));
+    uint32_t* d1 = malloc(n * sizeof(uint32_t));
+    uint32_t* d2 = malloc(n * sizeof(uint32_t));
+    int ok = v && c && x && y && d1 && d2;
+
+    uint64_t seed = 0xD1B54A32D192ED03ULL;
+    for (size_t i = 0; ok && i < n; ++i) {
+        seed ^= seed >> 12; seed ^= seed << 25; seed ^= seed >> 27;
+        v[i] = seed * 0x2545F4914F6CDD1DULL;
+        x[i] = (uint32_t)(v[i] >> 17);
+    }
+
+    /* a recognisable key pair as produced by convert_key_array_to_uint32 */
+    uint8_t rk24n[9] = { 0, 0x3, 0xA, 0x5, 0xC, 0x1, 0xE, 0x7, 0x9 };
+    uint8_t rk23n[9] = { 0, 0xF, 0x2, 0x8, 0x4, 0xB, 0x6, 0xD, 0x0 };
+    uint32_t rk24 = convert_key_array_to_uint32(rk24n);
+    uint32_t rk23 = convert_key_array_to_uint32(rk23n);
+
+    int saved = (int)(batch_kernels() - g_kernels);
+    for (int level = BATCH_KERNEL_SCALAR; ok && level <= batch_cpu_level(); ++level) {
+        batch_set_kernel(level);
+
+        table_lookup_batch(x, n, y);
+        encrypt_batch(v, n, ks, c);
+        decrypt_half_batch(v, n, rk24, rk23, d1, d2);
+
+        for (size_t i = 0; ok && i < n; ++i) {
+            uint64_t ref;
+            encrypt(v[i], (KeySchedule*)ks, &ref);
+            ok = y[i] == (uint32_t)Table_lookup(x[i])
+                && c[i] == ref
+                && d1[i] == decrypt_half_one_round(v[i], rk24n)
+                && d2[i] == decrypt_half_two_round(v[i], rk24n, rk23n);
+        }
+        if (!ok)
+            printf("[!] batch kernel \"%s\" disagrees with MGFN_18R.c\n", g_kernels[level].name);
+    }
+    batch_set_kernel(saved);
+
+    free(v); free(c); free(x); free(y); free(d1); free(d2);
+    return ok;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  End of file                                                               */
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,94 @@
+﻿#pragma once
+
+// MGFN_18R_batch.h — array APIs with SIMD kernels and runtime CPU dispatch
+
+#ifndef MGFN_18R_BATCH_H
+#define MGFN_18R_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MGFN_18R.h"   /* KeySchedule, te1..te4 */
+
+    /* -------------------------------------------------------------------------- */
+    /*  Public constants                                                          */
+    /* -------------------------------------------------------------------------- */
+
+    /* Kernel levels, in order of preference */
+#define BATCH_KERNEL_SCALAR   0
+#define BATCH_KERNEL_AVX2     1   /* 8 lanes, te1..te4 through vpgatherdd        */
+#define BATCH_KERNEL_AVX512   2   /* 16 lanes, per‑nibble tables through vpermd   */
+
+    /* -------------------------------------------------------------------------- */
+    /*  API – batch primitives                                                    */
+    /* -------------------------------------------------------------------------- */
+
+    /* out[i] = Table_lookup(in[i]) */
+    void table_lookup_batch(
+        const uint32_t* in,
+        size_t n,
+        uint32_t* out
+    );
+
+    /* ct[i] = encrypt(pt[i]) under one key schedule */
+    void encrypt_batch(
+        const uint64_t* pt,
+        size_t n,
+        const KeySchedule* ks,
+        uint64_t* ct
+    );
+
+    /*
+     * Batched decrypt_half_one_round / decrypt_half_two_round with keys that are
+     * already packed by convert_key_array_to_uint32():
+     *     d1[i] = decrypt_half_one_round1(ct[i], rk24)
+     *     d2[i] = decrypt_half_two_round (ct[i], rk24, rk23)
+     * `d2` may be NULL when only the one‑round value is needed.
+     */
+    void decrypt_half_batch(
+        const uint64_t* ct,
+        size_t n,
+        uint32_t rk24,
+        uint32_t rk23,
+        uint32_t* d1,
+        uint32_t* d2
+    );
+
+    /* -------------------------------------------------------------------------- */
+    /*  API – dispatch control                                                    */
+    /* -------------------------------------------------------------------------- */
+
+    /* Best kernel level supported by this CPU (and compiler). */
+    int batch_cpu_level(void);
+
+    /*
+     * Caps the kernel level used by the batch APIs (e.g. to compare kernels or
+     * to rule one out).  The effective level is min(level, batch_cpu_level()).
+     * Returns the level actually selected.
+     */
+    int batch_set_kernel(
+        int level
+    );
+
+    /* Human‑readable name of the selected kernel ("scalar", "avx2", …). */
+    const char* batch_kernel_name(void);
+
+    /*
+     * Runs every kernel the CPU supports against the scalar reference
+     * (`Table_lookup`, `encrypt`, `decrypt_half_*`) on `n` pseudo‑random
+     * inputs.  The previously selected kernel is restored afterwards.
+     * Returns 1 when all kernels agree.
+     */
+    int batch_self_test(
+        const KeySchedule* ks,
+        size_t n
+    );
+
+    /* -------------------------------------------------------------------------- */
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* MGFN_18R_BATCH_H */
@@ -0,0 +1,238 @@
+﻿/*-----------------------------------------------------------------------------
+ * MGFN_18R_bitslice.c — 64‑way bitsliced MGFN‑18R
+ * ---------------------------------------------------------------------------
+ * The round function of MGFN‑18R is eight 4‑bit S‑boxes followed by a 32‑bit
+ * bit permutation; te1..te4 in MGFN_18R.c are merely that composition folded
+ * into byte tables.  Here the S‑box is evaluated as a boolean circuit on 64
+ * lanes at once, and the permutation costs nothing: each S‑box output is
+ * XOR‑ed straight into the Feistel half it ends up in.
+ *
+ * Nibble inputs (LSB first) and output wires of the eight S‑boxes:
+ *
+ *   S‑box   input bits        output bits (y0,y1,y2,y3)
+ *   0       0  1  2  3        14 26  1 28
+ *   1       4  5  6  7        20  8 29  0
+ *   2       8  9 10 11         4 11 18  7
+ *   3      12 13 14 15        23 19  2 25
+ *   4      31 16 17 18        16 30 10 27
+ *   5      19 20 21 22        31  5 15 21
+ *   6      23 24 25 26         9 13 24  6
+ *   7      27 28 29 30        17 12 22  3
+ *----------------------------------------------------------------------------*/
+
+#include "MGFN_18R_bitslice.h"
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/*  Layout conversion                                                         */
+/* -------------------------------------------------------------------------- */
+
+void bs_transpose64(uint64_t a[64])
+{
+    static const uint64_t mask[6] = {
+        0x00000000FFFFFFFFULL, 0x0000FFFF0000FFFFULL, 0x00FF00FF00FF00FFULL,
+        0x0F0F0F0F0F0F0F0FULL, 0x3333333333333333ULL, 0x5555555555555555ULL
+    };
+
+    for (int j = 32, k = 0; j; j >>= 1, ++k) {
+        for (int i = 0; i < 64; i = (i + j + 1) & ~j) {
+            uint64_t t = ((a[i] >> j) ^ a[i + j]) & mask[k];
+            a[i] ^= t << j;
+            a[i + j] ^= t;
+        }
+    }
+}
+
+void bs_key_schedule_broadcast(
+    const KeySchedule* ks,
+    BitslicedKeySchedule* bks
+) {
+    for (int w = 0; w < BS_RK_WORDS; ++w)
+        for (int b = 0; b < 64; ++b)
+            bks->plane[w][b] = ((ks->rk[w] >> b) & 1) ? ~0ULL : 0ULL;
+}
+
+void bs_key_schedule_lanes(
+    const KeySchedule ks[BS_LANES],
+    BitslicedKeySchedule* bks
+) {
+    for (int w = 0; w < BS_RK_WORDS; ++w) {
+        for (int l = 0; l < BS_LANES; ++l)
+            bks->plane[w][l] = ks[l].rk[w];
+        bs_transpose64(bks->plane[w]);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*  S‑box circuit                                                             */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * Algebraic normal form of S = {7,E,F,0,D,B,8,1,9,3,4,C,2,5,A,6}:
+ *   y0 = 1 ^ x0 ^ x0x2 ^ x1x2 ^ x0x1x2 ^ x0x3 ^ x1x3 ^ x2x3
+ *   y1 = 1 ^ x0x1 ^ x2 ^ x0x2 ^ x3 ^ x0x3 ^ x0x2x3
+ *   y2 = 1 ^ x0x1 ^ x0x2 ^ x1x2 ^ x3 ^ x1x3 ^ x0x1x3
+ *   y3 = x0 ^ x1 ^ x2 ^ x0x2 ^ x1x2 ^ x0x1x2 ^ x3 ^ x1x2x3
+ * The outputs are XOR‑ed into (d0..d3), which is how the Feistel add is done.
+ */
+#define BS_SBOX_XOR(x0, x1, x2, x3, d0, d1, d2, d3) do {              \
+        uint64_t a01 = (x0) & (x1), a02 = (x0) & (x2);                 \
+        uint64_t a03 = (x0) & (x3), a12 = (x1) & (x2);                 \
+        uint64_t a13 = (x1) & (x3), a23 = (x2) & (x3);                 \
+        uint64_t t = a02 ^ a12 ^ (a12 & (x0));                         \
+        (d0) ^= ~((x0) ^ t ^ a03 ^ a13 ^ a23);                         \
+        (d1) ^= ~(a01 ^ (x2) ^ a02 ^ (x3) ^ a03 ^ (a02 & (x3)));       \
+        (d2) ^= ~(a01 ^ a02 ^ a12 ^ (x3) ^ a13 ^ (a01 & (x3)));        \
+        (d3) ^= (x0) ^ (x1) ^ (x2) ^ (x3) ^ t ^ (a12 & (x3));          \
+    } while (0)
+
+/* One Feistel round: l ^= F(h ^ k).  The caller swaps the roles of h and l. */
+static inline void bs_round(
+    const uint64_t* h,
+    uint64_t* l,
+    const uint64_t* k
+) {
+    uint64_t x[32];
+    for (int b = 0; b < 32; ++b)
+        x[b] = h[b] ^ k[b];
+
+    BS_SBOX_XOR(x[0], x[1], x[2], x[3], l[14], l[26], l[1], l[28]);
+    BS_SBOX_XOR(x[4], x[5], x[6], x[7], l[20], l[8], l[29], l[0]);
+    BS_SBOX_XOR(x[8], x[9], x[10], x[11], l[4], l[11], l[18], l[7]);
+    BS_SBOX_XOR(x[12], x[13], x[14], x[15], l[23], l[19], l[2], l[25]);
+    BS_SBOX_XOR(x[31], x[16], x[17], x[18], l[16], l[30], l[10], l[27]);
+    BS_SBOX_XOR(x[19], x[20], x[21], x[22], l[31], l[5], l[15], l[21]);
+    BS_SBOX_XOR(x[23], x[24], x[25], x[26], l[9], l[13], l[24], l[6]);
+    BS_SBOX_XOR(x[27], x[28], x[29], x[30], l[17], l[12], l[22], l[3]);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Encryption                                                                */
+/* -------------------------------------------------------------------------- */
+
+void bs_encrypt_rounds(
+    uint64_t s[64],
+    const BitslicedKeySchedule* bks,
+    int first,
+    int last
+) {
+    /* s[32..63] is the left (high) half, s[0..31] the right half */
+    uint64_t* h = s + 32;
+    uint64_t* l = s;
+    for (int r = first; r <= last; ++r) {
+        bs_round(h, l, bks->plane[r]);
+        uint64_t* t = h; h = l; l = t;   /* swap halves */
+    }
+
+    /* an odd number of rounds leaves the high half in s[0..31] */
+    if (h != s + 32) {
+        for (int b = 0; b < 32; ++b) {
+            uint64_t t = s[b]; s[b] = s[32 + b]; s[32 + b] = t;
+        }
+    }
+}
+
+void bs_encrypt_planes(
+    uint64_t s[64],
+    const BitslicedKeySchedule* bks
+) {
+    for (int b = 0; b < 64; ++b)
+        s[b] ^= bks->plane[0][b];
+
+    bs_encrypt_rounds(s, bks, 1, 18);
+
+    for (int b = 0; b < 64; ++b)
+        s[b] ^= bks->plane[19][b];
+}
+
+void bs_encrypt64(
+    const uint64_t plaintext[BS_LANES],
+    const BitslicedKeySchedule* bks,
+    uint64_t ciphertext[BS_LANES]
+) {
+    uint64_t s[64];
+    memcpy(s, plaintext, sizeof(s));
+    bs_transpose64(s);
+    bs_encrypt_planes(s, bks);
+    bs_transpose64(s);
+    memcpy(ciphertext, s, sizeof(s));
+}
+
+void bs_encrypt_keys(
+    uint64_t plaintext,
+    const BitslicedKeySchedule* bks,
+    uint64_t ciphertext[BS_LANES]
+) {
+    uint64_t s[64];
+    for (int b = 0; b < 64; ++b)
+        s[b] = ((plaintext >> b) & 1) ? ~0ULL : 0ULL;
+    bs_encrypt_planes(s, bks);
+    bs_transpose64(s);
+    memcpy(ciphertext, s, sizeof(s));
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Cross‑check against the T‑table implementation                            */
+/* -------------------------------------------------------------------------- */
+
+static uint64_t bs_test_next(uint64_t* x)
+{
+    /* xorshift64* — only needs to be different from block to block */
+    *x ^= *x >> 12;
+    *x ^= *x << 25;
+    *x ^= *x >> 27;
+    return *x * 0x2545F4914F6CDD1DULL;
+}
+
+int bs_self_test(
+    const KeySchedule* ks,
+    uint64_t blocks
+) {
+    BitslicedKeySchedule bks;
+    KeySchedule lane_ks[BS_LANES];
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    uint64_t pt[BS_LANES], ct[BS_LANES], ref;
+
+    /* (1) one key in every lane */
+    bs_key_schedule_broadcast(ks, &bks);
+    for (uint64_t done = 0; done < blocks; done += BS_LANES) {
+        for (int l = 0; l < BS_LANES; ++l)
+            pt[l] = bs_test_next(&seed);
+        bs_encrypt64(pt, &bks, ct);
+        for (int l = 0; l < BS_LANES; ++l) {
+            encrypt(pt[l], (KeySchedule*)ks, &ref);
+            if (ref != ct[l])
+                return 0;
+        }
+    }
+
+    /* (2) a different key per lane */
+    for (int l = 0; l < BS_LANES; ++l) {
+        uint8_t mk[KEY];
+        for (int i = 0; i < KEY; ++i)
+            mk[i] = (uint8_t)bs_test_next(&seed);
+        key_schedule(mk, &lane_ks[l]);
+    }
+    bs_key_schedule_lanes(lane_ks, &bks);
+    for (int l = 0; l < BS_LANES; ++l)
+        pt[l] = bs_test_next(&seed);
+    bs_encrypt64(pt, &bks, ct);
+    for (int l = 0; l < BS_LANES; ++l) {
+        encrypt(pt[l], &lane_ks[l], &ref);
+        if (ref != ct[l])
+            return 0;
+    }
+
+    /* (3) one block under every lane's key */
+    bs_encrypt_keys(pt[0], &bks, ct);
+    for (int l = 0; l < BS_LANES; ++l) {
+        encrypt(pt[0], &lane_ks[l], &ref);
+        if (ref != ct[l])
+            return 0;
+    }
+    return 1;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  End of file                                                               */
+/* -------------------------------------------------------------------------- */
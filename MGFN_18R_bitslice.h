@@ -0,0 +1,147 @@
+﻿#pragma once
+
+// MGFN_18R_bitslice.h — 64‑way bitsliced encryption engine
+
+#ifndef MGFN_18R_BITSLICE_H
+#define MGFN_18R_BITSLICE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "MGFN_18R.h"   /* KeySchedule and the reference table implementation */
+
+/*
+ * MSVC emits POPCNT for __popcnt64 whatever the target, so it is only used
+ * when the build already requires AVX (every AVX CPU has POPCNT).  GCC and
+ * Clang lower __builtin_popcountll to a safe sequence without -mpopcnt.
+ */
+#if defined(_MSC_VER) && defined(_M_X64) && defined(__AVX__)
+#define BS_HAVE_POPCNT64 1
+#include <intrin.h>     /* __popcnt64 */
+#endif
+
+    /* -------------------------------------------------------------------------- */
+    /*  Public constants                                                          */
+    /* -------------------------------------------------------------------------- */
+
+#define BS_LANES       64      /* blocks processed per bitsliced call       */
+#define BS_RK_WORDS    20      /* rk[0] … rk[19] of KeySchedule             */
+
+    /* -------------------------------------------------------------------------- */
+    /*  Data structures                                                           */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * Bitsliced view of a key schedule: plane[w][b] holds bit b of rk[w] for all
+     * 64 lanes (bit l of the word belongs to lane l).  Round keys rk[1..18] only
+     * use planes 0..31; the whitening keys rk[0] and rk[19] use all 64.
+     *
+     * When every lane shares one key the planes are simply 0 or ~0, but the
+     * layout also allows a different key per lane.
+     */
+    typedef struct {
+        uint64_t plane[BS_RK_WORDS][64];
+    } BitslicedKeySchedule;
+
+    /* -------------------------------------------------------------------------- */
+    /*  Plane helpers                                                             */
+    /* -------------------------------------------------------------------------- */
+
+    /* Number of lanes set in a plane word */
+    static inline int bs_popcount64(uint64_t x)
+    {
+#if defined(BS_HAVE_POPCNT64)
+        return (int)__popcnt64(x);
+#elif defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(x);
+#else
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+
+    /* -------------------------------------------------------------------------- */
+    /*  API – layout conversion                                                   */
+    /* -------------------------------------------------------------------------- */
+
+    /* In‑place 64×64 bit‑matrix transpose: bit c of a[r] ↔ bit r of a[c]. */
+    void bs_transpose64(
+        uint64_t a[64]
+    );
+
+    /* Broadcast one KeySchedule to all 64 lanes. */
+    void bs_key_schedule_broadcast(
+        const KeySchedule* ks,
+        BitslicedKeySchedule* bks
+    );
+
+    /* Load 64 independent KeySchedules, ks[l] going to lane l. */
+    void bs_key_schedule_lanes(
+        const KeySchedule ks[BS_LANES],
+        BitslicedKeySchedule* bks
+    );
+
+    /* -------------------------------------------------------------------------- */
+    /*  API – encryption core                                                     */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * Encrypts 64 blocks held as bit planes: s[b] is bit b of every lane's
+     * state.  The S‑box layer is a boolean circuit and the bit permutation is
+     * pure wire renaming, so a round costs no table loads at all.
+     */
+    void bs_encrypt_planes(
+        uint64_t s[64],
+        const BitslicedKeySchedule* bks
+    );
+
+    /*
+     * Rounds first..last (1 ≤ first ≤ last ≤ 18) of bs_encrypt_planes()
+     * without the whitening keys, so a caller can stop after any round and
+     * look at the state.  On return s[32..63] is the high half, as on entry.
+     */
+    void bs_encrypt_rounds(
+        uint64_t s[64],
+        const BitslicedKeySchedule* bks,
+        int first,
+        int last
+    );
+
+    /* Convenience wrapper: transpose in, encrypt, transpose out. */
+    void bs_encrypt64(
+        const uint64_t plaintext[BS_LANES],
+        const BitslicedKeySchedule* bks,
+        uint64_t ciphertext[BS_LANES]
+    );
+
+    /*
+     * Encrypts one block under the 64 lane keys of `bks` (see
+     * bs_key_schedule_lanes): ciphertext[l] is the block under lane l's key.
+     * The plaintext planes are all 0 or ~0, so one call serves 64 keys.
+     */
+    void bs_encrypt_keys(
+        uint64_t plaintext,
+        const BitslicedKeySchedule* bks,
+        uint64_t ciphertext[BS_LANES]
+    );
+
+    /*
+     * Cross‑checks the bitsliced engine against the T‑table `encrypt()` on
+     * `blocks` pseudo‑random inputs (rounded up to a multiple of 64), both with
+     * a broadcast key and with per‑lane keys (one block per lane, and one
+     * block under all lane keys).  Returns 1 when all agree.
+     */
+    int bs_self_test(
+        const KeySchedule* ks,
+        uint64_t blocks
+    );
+
+    /* -------------------------------------------------------------------------- */
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* MGFN_18R_BITSLICE_H */
@@ -0,0 +1,290 @@
+﻿/*-----------------------------------------------------------------------------
+ * dataset_async.c — read‑ahead of a byte range on dedicated I/O threads
+ * ---------------------------------------------------------------------------
+ * A scan over 2^33 pairs is one long sequential read.  With blocking reads
+ * every counting thread stalls on its own chunk; here I/O threads walk the
+ * range block by block into a ring of aligned buffers, so the disks always
+ * have the next blocks queued while the OpenMP team counts.
+ *
+ * Slot s of the ring holds block index ≡ s (mod depth).  An I/O thread only
+ * refills a slot after its previous block was released, and a consumer only
+ * waits for a block whose slot will be refilled, so as long as blocks are
+ * acquired in (roughly) increasing order nothing can deadlock.
+ *----------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dataset_async.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/* Slot states */
+#define SLOT_FREE     0   /* may be refilled                        */
+#define SLOT_LOADING  1   /* read in progress                       */
+#define SLOT_READY    2   /* block `index` waits for its consumer   */
+#define SLOT_TAKEN    3   /* handed out, not yet released           */
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+    int      state;       /* SLOT_*                                  */
+    int64_t  index;       /* block last loaded into the slot, or ‑1  */
+    size_t   skew;        /* bytes before the block in buf           */
+    size_t   len;         /* valid bytes of the block                */
+    uint8_t* buf;
+} AsyncSlot;
+
+struct DataAsync {
+    DataReadFn read;
+    void*      ctx;
+    uint64_t   offset;
+    uint64_t   bytes;
+    size_t     block;
+    uint64_t   nblocks;
+    int        depth;
+    int        stop;
+    AsyncSlot* slot;
+    int        threads;
+    int        started;   /* I/O threads running                     */
+    int        next_id;   /* handed to each I/O thread at start      */
+#ifdef _WIN32
+    CRITICAL_SECTION   lock;
+    CONDITION_VARIABLE cv;
+    HANDLE*            thread;
+#else
+    pthread_mutex_t    lock;
+    pthread_cond_t     cv;
+    pthread_t*         thread;
+#endif
+};
+
+/* -------------------------------------------------------------------------- */
+/*  Locking                                                                   */
+/* -------------------------------------------------------------------------- */
+
+#ifdef _WIN32
+#define ASYNC_LOCK(as)       EnterCriticalSection(&(as)->lock)
+#define ASYNC_UNLOCK(as)     LeaveCriticalSection(&(as)->lock)
+#define ASYNC_WAIT(as)       SleepConditionVariableCS(&(as)->cv, &(as)->lock, INFINITE)
+#define ASYNC_WAKE(as)       WakeAllConditionVariable(&(as)->cv)
+#else
+#define ASYNC_LOCK(as)       pthread_mutex_lock(&(as)->lock)
+#define ASYNC_UNLOCK(as)     pthread_mutex_unlock(&(as)->lock)
+#define ASYNC_WAIT(as)       pthread_cond_wait(&(as)->cv, &(as)->lock)
+#define ASYNC_WAKE(as)       pthread_cond_broadcast(&(as)->cv)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*  I/O thread                                                                */
+/* -------------------------------------------------------------------------- */
+
+static void async_run(DataAsync* as)
+{
+    ASYNC_LOCK(as);
+    uint64_t id = (uint64_t)as->next_id++;
+    ASYNC_UNLOCK(as);
+
+    for (uint64_t i = id; i < as->nblocks; i += (uint64_t)as->threads) {
+        AsyncSlot* s = &as->slot[i % (uint64_t)as->depth];
+
+        /* the slot's previous block must be gone, not just any block */
+        int64_t prev = (i >= (uint64_t)as->depth) ? (int64_t)(i - (uint64_t)as->depth) : -1;
+
+        ASYNC_LOCK(as);
+        while ((s->state != SLOT_FREE || s->index != prev) && !as->stop)
+            ASYNC_WAIT(as);
+        if (as->stop) {
+            ASYNC_UNLOCK(as);
+            return;
+        }
+        s->state = SLOT_LOADING;
+        s->index = (int64_t)i;
+        ASYNC_UNLOCK(as);
+
+        /* Widen to DATA_FILE_ALIGN: the range itself starts after the header */
+        uint64_t start = as->offset + i * as->block;
+        uint64_t end = as->offset + as->bytes;
+        if (end - start > as->block)
+            end = start + as->block;
+        uint64_t a0 = start & ~(uint64_t)(DATA_FILE_ALIGN - 1);
+        uint64_t a1 = (end + DATA_FILE_ALIGN - 1) & ~(uint64_t)(DATA_FILE_ALIGN - 1);
+        size_t got = as->read(as->ctx, s->buf, (size_t)(a1 - a0), a0);
+        size_t skew = (size_t)(start - a0);
+        size_t len = got > skew ? got - skew : 0;
+        if (len > end - start)
+            len = (size_t)(end - start);
+
+        ASYNC_LOCK(as);
+        s->skew = skew;
+        s->len = len;
+        s->state = SLOT_READY;
+        ASYNC_WAKE(as);
+        ASYNC_UNLOCK(as);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI async_main(LPVOID arg)
+{
+    async_run((DataAsync*)arg);
+    return 0;
+}
+#else
+static void* async_main(void* arg)
+{
+    async_run((DataAsync*)arg);
+    return NULL;
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*  Start / stop                                                              */
+/* -------------------------------------------------------------------------- */
+
+static void free_ring(DataAsync* as)
+{
+    for (int s = 0; s < as->depth; ++s)
+        data_aligned_free(as->slot[s].buf);
+    free(as->slot);
+    free(as->thread);
+    free(as);
+}
+
+DataAsync* data_async_start(DataReadFn read, void* ctx, uint64_t offset, uint64_t bytes,
+    size_t block, int depth, int threads)
+{
+    if (!block || depth < 2 || threads < 1)
+        return NULL;
+
+    DataAsync* as = calloc(1, sizeof(*as));
+    if (!as)
+        return NULL;
+    as->slot = calloc((size_t)depth, sizeof(AsyncSlot));
+    as->thread = calloc((size_t)threads, sizeof(*as->thread));
+    if (!as->slot || !as->thread) {
+        free(as->slot);
+        free(as->thread);
+        free(as);
+        return NULL;
+    }
+    as->read = read;
+    as->ctx = ctx;
+    as->threads = threads;
+    as->offset = offset;
+    as->bytes = bytes;
+    as->block = block;
+    as->nblocks = (bytes + block - 1) / block;
+    as->depth = depth;
+
+    /* room for the block plus alignment slack on both ends */
+    size_t cap = (block + 2 * DATA_FILE_ALIGN - 1) & ~(size_t)(DATA_FILE_ALIGN - 1);
+    for (int s = 0; s < depth; ++s) {
+        as->slot[s].index = -1;
+        as->slot[s].buf = data_aligned_alloc(cap);
+        if (!as->slot[s].buf) {
+            free_ring(as);
+            return NULL;
+        }
+    }
+
+#ifdef _WIN32
+    InitializeCriticalSection(&as->lock);
+    InitializeConditionVariable(&as->cv);
+    for (; as->started < threads; ++as->started) {
+        as->thread[as->started] = CreateThread(NULL, 0, async_main, as, 0, NULL);
+        if (!as->thread[as->started])
+            break;
+    }
+#else
+    pthread_mutex_init(&as->lock, NULL);
+    pthread_cond_init(&as->cv, NULL);
+    for (; as->started < threads; ++as->started)
+        if (pthread_create(&as->thread[as->started], NULL, async_main, as) != 0)
+            break;
+#endif
+    if (as->started < threads) {
+        /* every block must have its thread: undo the partial start */
+        data_async_stop(as);
+        return NULL;
+    }
+    return as;
+}
+
+void data_async_stop(DataAsync* as)
+{
+    if (!as)
+        return;
+
+    ASYNC_LOCK(as);
+    as->stop = 1;
+    ASYNC_WAKE(as);
+    ASYNC_UNLOCK(as);
+
+    for (int t = 0; t < as->started; ++t) {
+#ifdef _WIN32
+        WaitForSingleObject(as->thread[t], INFINITE);
+        CloseHandle(as->thread[t]);
+#else
+        pthread_join(as->thread[t], NULL);
+#endif
+    }
+#ifdef _WIN32
+    DeleteCriticalSection(&as->lock);
+#else
+    pthread_cond_destroy(&as->cv);
+    pthread_mutex_destroy(&as->lock);
+#endif
+    free_ring(as);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Consumers                                                                 */
+/* -------------------------------------------------------------------------- */
+
+const uint8_t* data_async_acquire(DataAsync* as, uint64_t index, size_t* len)
+{
+    if (index >= as->nblocks)
+        return NULL;
+
+    AsyncSlot* s = &as->slot[index % (uint64_t)as->depth];
+    const uint8_t* p = NULL;
+
+    ASYNC_LOCK(as);
+    for (;;) {
+        if (s->index == (int64_t)index && s->state == SLOT_READY) {
+            s->state = SLOT_TAKEN;
+            p = s->buf + s->skew;
+            *len = s->len;
+            break;
+        }
+        /* already handed out, or the slot has moved past this block */
+        if (s->index > (int64_t)index
+            || (s->index == (int64_t)index && s->state != SLOT_LOADING)
+            || as->stop)
+            break;
+        ASYNC_WAIT(as);
+    }
+    ASYNC_UNLOCK(as);
+    return p;
+}
+
+void data_async_release(DataAsync* as, uint64_t index)
+{
+    AsyncSlot* s = &as->slot[index % (uint64_t)as->depth];
+
+    ASYNC_LOCK(as);
+    if (s->index == (int64_t)index && s->state == SLOT_TAKEN) {
+        s->state = SLOT_FREE;
+        ASYNC_WAKE(as);
+    }
+    ASYNC_UNLOCK(as);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  End of file                                                               */
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,81 @@
+﻿#pragma once
+
+// dataset_async.h — read‑ahead of a byte range on a dedicated I/O thread
+
+#ifndef DATASET_ASYNC_H
+#define DATASET_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dataset_io.h"         /* DATA_FILE_ALIGN */
+
+    /* -------------------------------------------------------------------------- */
+    /*  Data structures                                                           */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * Bytes offset … offset+bytes‑1 of a file (or of a striped set of files),
+     * cut into blocks of `block` bytes.  Dedicated I/O threads read the
+     * blocks in order into a ring of `depth` DATA_FILE_ALIGN‑aligned buffers
+     * and stay up to `depth` blocks ahead of the consumers, so the next
+     * blocks are in flight while the current one is being counted.
+     */
+    typedef struct DataAsync DataAsync;
+
+    /* Reads up to len bytes at offset, like data_file_pread(); offset and len are aligned */
+    typedef size_t (*DataReadFn)(void* ctx, void* buf, size_t len, uint64_t offset);
+
+    /* -------------------------------------------------------------------------- */
+    /*  API                                                                       */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * Starts `threads` I/O threads; thread t loads blocks t, t+threads, …, so
+     * with one thread per device and blocks laid out round‑robin over the
+     * devices every device has a read outstanding.  `read` may go to files
+     * opened with DATA_FILE_DIRECT: requests are widened to DATA_FILE_ALIGN.
+     * Returns NULL if the buffers or the threads cannot be created.
+     */
+    DataAsync* data_async_start(
+        DataReadFn read,
+        void* ctx,
+        uint64_t offset,
+        uint64_t bytes,
+        size_t block,
+        int depth,
+        int threads
+    );
+
+    /*
+     * Waits for block `index` and returns its bytes (*len of them, fewer only
+     * for the last block or at EOF).  Every block is handed out at most once
+     * and must be given back with data_async_release(); NULL means it is out
+     * of range or was already consumed, and the caller reads it directly.
+     * Blocks must be acquired roughly in order: a consumer never waits on a
+     * block more than `depth` ahead of one nobody will acquire.
+     */
+    const uint8_t* data_async_acquire(
+        DataAsync* as,
+        uint64_t index,
+        size_t* len
+    );
+
+    void data_async_release(
+        DataAsync* as,
+        uint64_t index
+    );
+
+    /* Stops the I/O threads and frees the ring. */
+    void data_async_stop(
+        DataAsync* as
+    );
+
+    /* -------------------------------------------------------------------------- */
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* DATASET_ASYNC_H */
@@ -0,0 +1,279 @@
+﻿/*-----------------------------------------------------------------------------
+ * dataset_io.c — positional file I/O for the (P,C) dataset
+ * ---------------------------------------------------------------------------
+ * pread/pwrite on POSIX, ReadFile/WriteFile with an OVERLAPPED offset on
+ * Windows.  Neither moves a shared file pointer, which is what lets every
+ * generator thread write its own index range without a lock.
+ *
+ * For the scan side a file can also be opened unbuffered (DATA_FILE_DIRECT),
+ * so a 128 GiB pass does not churn the page cache, or mapped into memory
+ * (data_file_map), so pair records can be used in place.
+ *----------------------------------------------------------------------------*/
+
+#ifndef _WIN32
+#define _GNU_SOURCE          /* O_DIRECT, MADV_HUGEPAGE */
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <string.h>
+
+#include "dataset_io.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Largest single read/write request (keeps DWORD / ssize_t happy) */
+#define DATA_FILE_MAX_IO  ((size_t)1 << 30)
+
+/* -------------------------------------------------------------------------- */
+/*  Open / close                                                              */
+/* -------------------------------------------------------------------------- */
+
+int data_file_open(DataFile* f, const char* path, int mode)
+{
+    int read_only = (mode == DATA_FILE_READ || mode == DATA_FILE_DIRECT);
+#ifdef _WIN32
+    DWORD access = read_only ? GENERIC_READ : (GENERIC_READ | GENERIC_WRITE);
+    DWORD disp = read_only ? OPEN_EXISTING
+        : (mode == DATA_FILE_WRITE) ? CREATE_ALWAYS : OPEN_ALWAYS;
+    DWORD attr = (mode == DATA_FILE_DIRECT) ? (FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN)
+        : FILE_ATTRIBUTE_NORMAL;
+    HANDLE h = CreateFileA(path, access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+        disp, attr, NULL);
+    if (h == INVALID_HANDLE_VALUE && mode == DATA_FILE_DIRECT)
+        h = CreateFileA(path, access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+            disp, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+        return 0;
+    f->handle = h;
+#else
+    int flags = read_only ? O_RDONLY
+        : (mode == DATA_FILE_WRITE) ? (O_RDWR | O_CREAT | O_TRUNC) : (O_RDWR | O_CREAT);
+    int fd = -1;
+#ifdef O_DIRECT
+    if (mode == DATA_FILE_DIRECT)
+        fd = open(path, flags | O_DIRECT, 0644);   /* EINVAL on tmpfs and friends */
+#endif
+    if (fd < 0)
+        fd = open(path, flags, 0644);
+    if (fd < 0)
+        return 0;
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+    if (mode == DATA_FILE_DIRECT)
+        fcntl(fd, F_NOCACHE, 1);
+#endif
+    f->fd = fd;
+#endif
+    f->map = NULL;
+    f->map_bytes = 0;
+    return 1;
+}
+
+void data_file_close(DataFile* f)
+{
+    if (f->map) {
+#ifdef _WIN32
+        UnmapViewOfFile((LPCVOID)f->map);
+#else
+        munmap((void*)f->map, (size_t)f->map_bytes);
+#endif
+        f->map = NULL;
+        f->map_bytes = 0;
+    }
+#ifdef _WIN32
+    CloseHandle((HANDLE)f->handle);
+    f->handle = NULL;
+#else
+    close(f->fd);
+    f->fd = -1;
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Size                                                                      */
+/* -------------------------------------------------------------------------- */
+
+uint64_t data_file_size(DataFile* f)
+{
+#ifdef _WIN32
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx((HANDLE)f->handle, &sz))
+        return UINT64_MAX;
+    return (uint64_t)sz.QuadPart;
+#else
+    struct stat st;
+    if (fstat(f->fd, &st) != 0)
+        return UINT64_MAX;
+    return (uint64_t)st.st_size;
+#endif
+}
+
+int data_file_resize(DataFile* f, uint64_t bytes)
+{
+#ifdef _WIN32
+    FILE_END_OF_FILE_INFO eof;
+    eof.EndOfFile.QuadPart = (LONGLONG)bytes;
+    return SetFileInformationByHandle((HANDLE)f->handle, FileEndOfFileInfo, &eof, sizeof(eof)) != 0;
+#else
+    return ftruncate(f->fd, (off_t)bytes) == 0;
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Positional read / write                                                   */
+/* -------------------------------------------------------------------------- */
+
+int data_file_pwrite(DataFile* f, const void* buf, size_t len, uint64_t offset)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+
+    while (len) {
+        size_t chunk = len < DATA_FILE_MAX_IO ? len : DATA_FILE_MAX_IO;
+#ifdef _WIN32
+        OVERLAPPED ov = { 0 };
+        DWORD done = 0;
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        if (!WriteFile((HANDLE)f->handle, p, (DWORD)chunk, &done, &ov) || done == 0)
+            return 0;
+#else
+        ssize_t done = pwrite(f->fd, p, chunk, (off_t)offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            return 0;
+#endif
+        p += done;
+        len -= (size_t)done;
+        offset += (uint64_t)done;
+    }
+    return 1;
+}
+
+int data_file_sync(DataFile* f)
+{
+#ifdef _WIN32
+    return FlushFileBuffers((HANDLE)f->handle) != 0;
+#else
+    return fsync(f->fd) == 0;
+#endif
+}
+
+int data_file_replace(const char* from, const char* to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+size_t data_file_pread(DataFile* f, void* buf, size_t len, uint64_t offset)
+{
+    uint8_t* p = (uint8_t*)buf;
+    size_t total = 0;
+
+    if (f->map) {
+        if (offset >= f->map_bytes)
+            return 0;
+        if (f->map_bytes - offset < len)
+            len = (size_t)(f->map_bytes - offset);
+        memcpy(p, f->map + offset, len);
+        return len;
+    }
+
+    while (len) {
+        size_t chunk = len < DATA_FILE_MAX_IO ? len : DATA_FILE_MAX_IO;
+#ifdef _WIN32
+        OVERLAPPED ov = { 0 };
+        DWORD done = 0;
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        if (!ReadFile((HANDLE)f->handle, p, (DWORD)chunk, &done, &ov) || done == 0)
+            break;
+#else
+        ssize_t done = pread(f->fd, p, chunk, (off_t)offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            break;
+#endif
+        p += done;
+        len -= (size_t)done;
+        offset += (uint64_t)done;
+        total += (size_t)done;
+    }
+    return total;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Memory mapping                                                            */
+/* -------------------------------------------------------------------------- */
+
+int data_file_map(DataFile* f)
+{
+    uint64_t bytes = data_file_size(f);
+    if (bytes == 0 || bytes == UINT64_MAX || (uint64_t)(size_t)bytes != bytes)
+        return 0;
+#ifdef _WIN32
+    /* Large pages need SeLockMemoryPrivilege and do not apply to file views */
+    HANDLE m = CreateFileMappingA((HANDLE)f->handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m)
+        return 0;
+    void* base = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(m);   /* the view keeps the mapping alive */
+    if (!base)
+        return 0;
+#else
+    void* base = mmap(NULL, (size_t)bytes, PROT_READ, MAP_SHARED, f->fd, 0);
+    if (base == MAP_FAILED)
+        return 0;
+    madvise(base, (size_t)bytes, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(base, (size_t)bytes, MADV_HUGEPAGE);   /* advisory; file THP where enabled */
+#endif
+#endif
+    f->map = (const uint8_t*)base;
+    f->map_bytes = bytes;
+    return 1;
+}
+
+const void* data_file_view(DataFile* f, uint64_t offset, uint64_t len)
+{
+    if (!f->map || offset > f->map_bytes || f->map_bytes - offset < len)
+        return NULL;
+    return f->map + offset;
+}
+
+void* data_aligned_alloc(size_t bytes)
+{
+#ifdef _WIN32
+    return _aligned_malloc(bytes, DATA_FILE_ALIGN);
+#else
+    void* p = NULL;
+    return posix_memalign(&p, DATA_FILE_ALIGN, bytes) == 0 ? p : NULL;
+#endif
+}
+
+void data_aligned_free(void* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/*  End of file                                                               */
+/* -------------------------------------------------------------------------- */
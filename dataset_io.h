@@ -0,0 +1,143 @@
+﻿#pragma once
+
+// dataset_io.h — positional file I/O for the (P,C) dataset
+
+#ifndef DATASET_IO_H
+#define DATASET_IO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+    /* -------------------------------------------------------------------------- */
+    /*  Public constants                                                          */
+    /* -------------------------------------------------------------------------- */
+
+#define DATA_FILE_READ    0   /* existing file, read only              */
+#define DATA_FILE_WRITE   1   /* create or truncate, read/write         */
+#define DATA_FILE_UPDATE  2   /* create if missing, keep contents       */
+#define DATA_FILE_DIRECT  3   /* existing file, read only, no OS cache  */
+
+    /*
+     * DATA_FILE_DIRECT reads bypass the page cache (O_DIRECT / F_NOCACHE /
+     * FILE_FLAG_NO_BUFFERING): offsets, lengths and buffers must then be
+     * multiples of DATA_FILE_ALIGN, except that a read may end at EOF.
+     */
+#define DATA_FILE_ALIGN   4096
+
+    /* -------------------------------------------------------------------------- */
+    /*  Data structures                                                           */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * Thin handle over a native file descriptor / HANDLE.  All reads and writes
+     * carry an explicit offset and never touch a shared file position, so any
+     * number of threads may use one DataFile concurrently.
+     */
+    typedef struct {
+#ifdef _WIN32
+        void* handle;
+#else
+        int   fd;
+#endif
+        const uint8_t* map;   /* data_file_map() view, or NULL           */
+        uint64_t map_bytes;
+    } DataFile;
+
+    /* -------------------------------------------------------------------------- */
+    /*  API                                                                       */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * Returns 1 on success, 0 on failure (errno / GetLastError is preserved).
+     * DATA_FILE_DIRECT falls back to a cached open where the file system
+     * refuses unbuffered I/O.
+     */
+    int data_file_open(
+        DataFile* f,
+        const char* path,
+        int mode
+    );
+
+    void data_file_close(
+        DataFile* f
+    );
+
+    /* Current size in bytes, or UINT64_MAX on error. */
+    uint64_t data_file_size(
+        DataFile* f
+    );
+
+    /* Grows or shrinks the file to exactly `bytes`.  Returns 1 on success. */
+    int data_file_resize(
+        DataFile* f,
+        uint64_t bytes
+    );
+
+    /* Writes all `len` bytes at `offset`.  Returns 1 on success. */
+    int data_file_pwrite(
+        DataFile* f,
+        const void* buf,
+        size_t len,
+        uint64_t offset
+    );
+
+    /* Forces written data to stable storage.  Returns 1 on success. */
+    int data_file_sync(
+        DataFile* f
+    );
+
+    /*
+     * Renames `from` to `to`, replacing an existing `to` in one step, so a
+     * reader sees either the old or the new file.  Returns 1 on success.
+     */
+    int data_file_replace(
+        const char* from,
+        const char* to
+    );
+
+    /*
+     * Reads up to `len` bytes at `offset`; returns the byte count (0 at EOF).
+     * A mapped file is served from the mapping.
+     */
+    size_t data_file_pread(
+        DataFile* f,
+        void* buf,
+        size_t len,
+        uint64_t offset
+    );
+
+    /*
+     * Maps the whole (read‑only) file and advises sequential access and huge
+     * pages where the OS supports them; later preads copy from the mapping
+     * and data_file_view() returns pointers into it.  Returns 1 on success.
+     * The mapping is released by data_file_close().
+     */
+    int data_file_map(
+        DataFile* f
+    );
+
+    /* Pointer to bytes offset … offset+len‑1 of a mapped file, or NULL. */
+    const void* data_file_view(
+        DataFile* f,
+        uint64_t offset,
+        uint64_t len
+    );
+
+    /* DATA_FILE_ALIGN‑aligned buffers for DATA_FILE_DIRECT reads */
+    void* data_aligned_alloc(
+        size_t bytes
+    );
+
+    void data_aligned_free(
+        void* p
+    );
+
+    /* -------------------------------------------------------------------------- */
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* DATASET_IO_H */
@@ -0,0 +1,890 @@
+﻿/*-----------------------------------------------------------------------------
+ * dataset_source.c — file‑backed and regenerate‑on‑demand (P,C) sources
+ * ---------------------------------------------------------------------------
+ * The attack rereads the first 2^27 … 2^33 pairs once per round·stage.  With
+ * the bitsliced engine, recomputing a pair is cheaper than pulling its 16
+ * bytes back off disk, so the oracle source never materialises the dataset:
+ * it replays the Philox plaintext stream and encrypts in 64‑block groups.
+ *
+ * File sources come in four encodings.  Every approximation reads only P
+ * bits 16 and 48, so the packed and ciphertext‑only formats drop the rest of
+ * the plaintext and roughly halve the bytes moved per stage.  The plane
+ * format goes further: each bit position is its own file, and a round‑0
+ * stage touches only the dozen or so planes it needs.
+ *
+ * How the bytes get in is up to the reader: plain preads, a memory mapping
+ * (pair records are then used in place), or I/O threads that read the
+ * chunks of an announced scan ahead of the counting threads.
+ *
+ * The single‑file formats can also be striped over several member files on
+ * different disks, so a scan is no longer bound to one device: consecutive
+ * stripes sit on consecutive members, and the chunks the counting threads
+ * (or the one‑per‑member I/O threads) read in parallel hit all of them.
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "dataset_source.h"
+#include "dataset_async.h"
+
+/* PackedBlocks decoded per pread */
+#define PACKED_READ_BLOCKS  16
+
+/* Plane words per pread when rebuilding whole pairs */
+#define PLANE_READ_WORDS    64
+
+/* Longest plane file name */
+#define PLANE_PATH_MAX      1024
+
+/* Read‑ahead ring: buffers per OpenMP thread, plus slack */
+#define ASYNC_DEPTH_PER_THREAD  2
+#define ASYNC_DEPTH_EXTRA       2
+
+/* Stripe member names: "<dir>/<name>.s00" … */
+#define STRIPE_SUFFIX       ".s%02d"
+
+/* -------------------------------------------------------------------------- */
+/*  Formats                                                                   */
+/* -------------------------------------------------------------------------- */
+
+uint64_t data_format_bytes(int format, uint64_t pairs)
+{
+    switch (format) {
+    case DATA_FORMAT_PACKED: return (pairs / BS_LANES) * sizeof(PackedBlock);
+    case DATA_FORMAT_CT:     return pairs * sizeof(uint64_t);
+    case DATA_FORMAT_PLANES: return (pairs / BS_LANES) * sizeof(uint64_t);
+    default:                 return pairs * sizeof(Pair);
+    }
+}
+
+uint64_t data_format_round(int format, uint64_t pairs)
+{
+    if (format == DATA_FORMAT_PACKED || format == DATA_FORMAT_PLANES)
+        return (pairs + BS_LANES - 1) / BS_LANES * BS_LANES;
+    return pairs;
+}
+
+void data_plane_path(char* out, size_t cap, const char* path, int plane)
+{
+    snprintf(out, cap, "%s.%c%02d", path,
+        plane < 64 ? 'p' : 'c', plane & 63);
+}
+
+const char* data_format_name(int format)
+{
+    switch (format) {
+    case DATA_FORMAT_PACKED: return "packed";
+    case DATA_FORMAT_CT:     return "ct";
+    case DATA_FORMAT_PLANES: return "planes";
+    default:                 return "pair";
+    }
+}
+
+int data_format_parse(const char* name)
+{
+    for (int f = DATA_FORMAT_PAIR; f <= DATA_FORMAT_PLANES; ++f)
+        if (strcmp(name, data_format_name(f)) == 0)
+            return f;
+    return -1;
+}
+
+const char* data_reader_name(int reader)
+{
+    switch (reader) {
+    case DATA_READER_MMAP:  return "mmap";
+    case DATA_READER_ASYNC: return "async";
+    default:                return "pread";
+    }
+}
+
+int data_reader_parse(const char* name)
+{
+    for (int r = DATA_READER_PREAD; r <= DATA_READER_ASYNC; ++r)
+        if (strcmp(name, data_reader_name(r)) == 0)
+            return r;
+    return -1;
+}
+
+/* Opens all DATA_PLANES plane files of `path`; on failure none stay open */
+static int open_planes(DataFile plane[DATA_PLANES], const char* path, int mode)
+{
+    char name[PLANE_PATH_MAX];
+    for (int b = 0; b < DATA_PLANES; ++b) {
+        data_plane_path(name, sizeof(name), path, b);
+        if (!data_file_open(&plane[b], name, mode)) {
+            while (b--)
+                data_file_close(&plane[b]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void close_planes(DataFile plane[DATA_PLANES])
+{
+    for (int b = 0; b < DATA_PLANES; ++b)
+        data_file_close(&plane[b]);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Header                                                                    */
+/* -------------------------------------------------------------------------- */
+
+void data_header_init(DataHeader* hdr, int format, uint64_t pairs, uint64_t seed, uint64_t key_fp)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, DATA_HEADER_MAGIC, sizeof(hdr->magic));
+    hdr->version = DATA_HEADER_VERSION;
+    hdr->format = (uint32_t)format;
+    hdr->pairs = pairs;
+    hdr->seed = seed;
+    hdr->key_fp = key_fp;
+}
+
+int data_header_read(const char* path, DataHeader* hdr)
+{
+    DataFile f;
+    if (!data_file_open(&f, path, DATA_FILE_READ))
+        return 0;
+    size_t got = data_file_pread(&f, hdr, sizeof(*hdr), 0);
+    data_file_close(&f);
+
+    /* version 1 files carry zeros where the stripe fields now are */
+    return got == sizeof(*hdr)
+        && memcmp(hdr->magic, DATA_HEADER_MAGIC, sizeof(hdr->magic)) == 0
+        && hdr->version >= 1 && hdr->version <= DATA_HEADER_VERSION
+        && hdr->format <= DATA_FORMAT_PLANES
+        && hdr->stripes <= DATA_STRIPES_MAX
+        && (hdr->stripes == 0 || (hdr->format != DATA_FORMAT_PLANES
+            && hdr->stripe_pairs && hdr->stripe_pairs % DATA_STRIPE_UNIT == 0));
+}
+
+int data_header_compatible(const DataHeader* have, const DataHeader* want)
+{
+    return have->format == want->format
+        && have->seed == want->seed
+        && have->key_fp == want->key_fp
+        && have->stripes == want->stripes
+        && (have->stripes == 0 || have->stripe_pairs == want->stripe_pairs);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Stripes                                                                   */
+/* -------------------------------------------------------------------------- */
+
+int data_stripes_init(DataStripes* st, const char* path, const char* dirs, uint64_t stripe_pairs)
+{
+    const char* name = path;
+    for (const char* p = path; *p; ++p)
+        if (*p == '/' || *p == '\\')
+            name = p + 1;
+
+    memset(st, 0, sizeof(*st));
+    if (!stripe_pairs || stripe_pairs % DATA_STRIPE_UNIT)
+        return 0;
+    st->pairs = stripe_pairs;
+
+    while (*dirs) {
+        const char* end = strchr(dirs, ',');
+        size_t len = end ? (size_t)(end - dirs) : strlen(dirs);
+        if (!len || st->count == DATA_STRIPES_MAX)
+            return 0;
+        int w = snprintf(st->path[st->count], DATA_PATH_MAX, "%.*s/%s" STRIPE_SUFFIX,
+            (int)len, dirs, name, st->count);
+        if (w < 0 || w >= DATA_PATH_MAX)
+            return 0;
+        ++st->count;
+        dirs += len + (end ? 1 : 0);
+    }
+    return st->count > 0;
+}
+
+int data_stripes_read(const char* path, const DataHeader* hdr, DataStripes* st)
+{
+    memset(st, 0, sizeof(*st));
+    if (!hdr->stripes)
+        return 1;
+
+    DataFile f;
+    if (!data_file_open(&f, path, DATA_FILE_READ))
+        return 0;
+    size_t bytes = (size_t)hdr->stripes * DATA_PATH_MAX;
+    size_t got = data_file_pread(&f, st->path, bytes, DATA_HEADER_BYTES);
+    data_file_close(&f);
+    if (got != bytes)
+        return 0;
+
+    st->count = (int)hdr->stripes;
+    st->pairs = hdr->stripe_pairs;
+    for (int m = 0; m < st->count; ++m)
+        st->path[m][DATA_PATH_MAX - 1] = '\0';
+    return 1;
+}
+
+int data_stripes_equal(const DataStripes* a, const DataStripes* b)
+{
+    if (a->count != b->count || (a->count && a->pairs != b->pairs))
+        return 0;
+    for (int m = 0; m < a->count; ++m)
+        if (strcmp(a->path[m], b->path[m]) != 0)
+            return 0;
+    return 1;
+}
+
+static void close_members(DataFile member[], int count)
+{
+    for (int m = 0; m < count; ++m)
+        data_file_close(&member[m]);
+}
+
+/* Opens all member files; on failure none stay open */
+static int open_members(DataFile member[], const DataStripes* st, int mode)
+{
+    for (int m = 0; m < st->count; ++m) {
+        if (!data_file_open(&member[m], st->path[m], mode)) {
+            close_members(member, m);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Record bytes of a single‑file dataset start right after the header; a
+ * striped one keeps stripe k in member k mod stripes.  Returns the file
+ * holding record byte `off`, its offset there, and the bytes left in the
+ * stripe.
+ */
+static DataFile* record_locate(DataFile* single, DataFile* member, int stripes,
+    uint64_t stripe_bytes, uint64_t off, uint64_t* at, uint64_t* room)
+{
+    if (!stripes) {
+        *at = DATA_HEADER_BYTES + off;
+        *room = UINT64_MAX;
+        return single;
+    }
+    uint64_t k = off / stripe_bytes;
+    *at = (k / (uint64_t)stripes) * stripe_bytes + off % stripe_bytes;
+    *room = stripe_bytes - off % stripe_bytes;
+    return &member[k % (uint64_t)stripes];
+}
+
+static size_t record_pread(DataFile* single, DataFile* member, int stripes,
+    uint64_t stripe_bytes, void* buf, size_t len, uint64_t off)
+{
+    uint8_t* p = (uint8_t*)buf;
+    size_t total = 0;
+
+    while (len) {
+        uint64_t at, room;
+        DataFile* f = record_locate(single, member, stripes, stripe_bytes, off, &at, &room);
+        size_t piece = (room < len) ? (size_t)room : len;
+        size_t got = data_file_pread(f, p, piece, at);
+        total += got;
+        if (got < piece)
+            break;
+        p += piece;
+        len -= piece;
+        off += piece;
+    }
+    return total;
+}
+
+static int record_pwrite(DataFile* single, DataFile* member, int stripes,
+    uint64_t stripe_bytes, const void* buf, size_t len, uint64_t off)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+
+    while (len) {
+        uint64_t at, room;
+        DataFile* f = record_locate(single, member, stripes, stripe_bytes, off, &at, &room);
+        size_t piece = (room < len) ? (size_t)room : len;
+        if (!data_file_pwrite(f, p, piece, at))
+            return 0;
+        p += piece;
+        len -= piece;
+        off += piece;
+    }
+    return 1;
+}
+
+/* Record bytes a member holds when the dataset has `bytes` of them */
+static uint64_t member_bytes(uint64_t bytes, int stripes, uint64_t stripe_bytes, int m)
+{
+    uint64_t full = bytes / stripe_bytes, rest = bytes % stripe_bytes;
+    uint64_t k = full / (uint64_t)stripes + ((uint64_t)m < full % (uint64_t)stripes);
+    return k * stripe_bytes + ((uint64_t)m == full % (uint64_t)stripes ? rest : 0);
+}
+
+/* Record bytes of `src` at offset `off`, wherever they are stored */
+static size_t src_pread(DataSource* src, void* buf, size_t len, uint64_t off)
+{
+    return record_pread(&src->file, src->member, src->stripes, src->stripe_bytes, buf, len, off);
+}
+
+/* Philox chained over rk[0..19]: cheap, and any key bit flips the digest */
+uint64_t data_key_fingerprint(const KeySchedule* ks)
+{
+    static const uint32_t fp_key[2] = { 0x4B455946, 0x50524E54 }; /* "FYEK" "TNRP" */
+    uint32_t h[4] = { 0, 0, 0, 0 };
+
+    for (int i = 0; i < BS_RK_WORDS; ++i) {
+        uint32_t ctr[4] = {
+            h[0] ^ (uint32_t)ks->rk[i], h[1] ^ (uint32_t)(ks->rk[i] >> 32), h[2], h[3] ^ (uint32_t)i };
+        philox4x32_10(ctr, fp_key, h);
+    }
+    return ((uint64_t)h[1] << 32) | h[0];
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Open / close                                                              */
+/* -------------------------------------------------------------------------- */
+
+int data_source_open_file(DataSource* src, const char* path, int reader)
+{
+    DataHeader hdr;
+    memset(src, 0, sizeof(*src));
+    if (!data_header_read(path, &hdr))
+        return 0;
+
+    int format = (int)hdr.format;
+    src->kind = DATA_SOURCE_FILE;
+    src->format = format;
+    src->seed = hdr.seed;
+    src->key_fp = hdr.key_fp;
+
+    /* trust the header, but never past the bytes actually on disk */
+    uint64_t pairs;
+    if (format == DATA_FORMAT_PLANES) {
+        if (!open_planes(src->plane, path, DATA_FILE_READ))
+            return 0;
+        uint64_t words = UINT64_MAX;
+        for (int b = 0; b < DATA_PLANES; ++b) {
+            uint64_t w = data_file_size(&src->plane[b]) / sizeof(uint64_t);
+            if (w < words)
+                words = w;
+        }
+        pairs = words * BS_LANES;
+    }
+    else {
+        DataStripes st;
+        uint64_t bytes;
+        if (!data_stripes_read(path, &hdr, &st) || !data_file_open(&src->file, path, DATA_FILE_READ))
+            return 0;
+        if (st.count) {
+            if (!open_members(src->member, &st, DATA_FILE_READ)) {
+                data_file_close(&src->file);
+                return 0;
+            }
+            src->stripes = st.count;
+            src->stripe_bytes = data_format_bytes(format, st.pairs);
+
+            /* the records are contiguous up to the first stripe a member is missing */
+            uint64_t want = data_format_bytes(format, hdr.pairs);
+            bytes = 0;
+            for (uint64_t k = 0; bytes < want; ++k) {
+                uint64_t size = data_file_size(&src->member[k % (uint64_t)st.count]);
+                uint64_t at = (k / (uint64_t)st.count) * src->stripe_bytes;
+                if (size == UINT64_MAX || size <= at)
+                    break;
+                bytes += (size - at < src->stripe_bytes) ? size - at : src->stripe_bytes;
+                if (size - at < src->stripe_bytes)
+                    break;
+            }
+        }
+        else {
+            bytes = data_file_size(&src->file);
+            bytes = (bytes == UINT64_MAX || bytes < DATA_HEADER_BYTES) ? 0 : bytes - DATA_HEADER_BYTES;
+        }
+        if (format == DATA_FORMAT_PACKED)
+            pairs = bytes / sizeof(PackedBlock) * BS_LANES;
+        else
+            pairs = bytes / data_format_bytes(format, 1);
+    }
+    src->pairs = hdr.pairs < pairs ? hdr.pairs : pairs;
+
+    if (reader == DATA_READER_MMAP) {
+        int ok = 1;
+        if (format == DATA_FORMAT_PLANES) {
+            for (int b = 0; b < DATA_PLANES; ++b)
+                ok &= data_file_map(&src->plane[b]);
+        }
+        else if (src->stripes) {
+            for (int m = 0; m < src->stripes; ++m)
+                ok &= data_file_map(&src->member[m]);
+        }
+        else {
+            ok = data_file_map(&src->file);
+        }
+        /* unmapped plane or member files simply keep using pread */
+        src->reader = ok ? DATA_READER_MMAP : DATA_READER_PREAD;
+    }
+    else if (reader == DATA_READER_ASYNC && format != DATA_FORMAT_PLANES) {
+        int ok;
+        if (src->stripes) {
+            DataStripes st;
+            ok = data_stripes_read(path, &hdr, &st) && open_members(src->direct, &st, DATA_FILE_DIRECT);
+        }
+        else {
+            ok = data_file_open(&src->direct[0], path, DATA_FILE_DIRECT);
+        }
+        if (ok)
+            src->reader = DATA_READER_ASYNC;
+    }
+    return 1;
+}
+
+void data_source_open_oracle(DataSource* src,
+    const KeySchedule* ks,
+    uint64_t seed,
+    uint64_t pairs)
+{
+    memset(src, 0, sizeof(*src));
+    src->kind = DATA_SOURCE_ORACLE;
+    src->pairs = pairs;
+    src->seed = seed;
+    src->key_fp = data_key_fingerprint(ks);
+    bs_key_schedule_broadcast(ks, &src->bks);
+}
+
+void data_source_close(DataSource* src)
+{
+    data_source_stream_end(src);
+    if (src->reader == DATA_READER_ASYNC)
+        close_members(src->direct, src->stripes ? src->stripes : 1);
+    src->reader = DATA_READER_PREAD;
+    if (src->kind == DATA_SOURCE_FILE) {
+        if (src->format == DATA_FORMAT_PLANES) {
+            close_planes(src->plane);
+        }
+        else {
+            close_members(src->member, src->stripes);
+            data_file_close(&src->file);
+        }
+    }
+    src->stripes = 0;
+    src->pairs = 0;
+}
+
+const char* data_source_name(const DataSource* src)
+{
+    static const char* names[] = { "file (pair)", "file (packed)", "file (ct)", "file (planes)" };
+    if (src->kind == DATA_SOURCE_ORACLE)
+        return "oracle";
+    return names[src->format];
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Read                                                                      */
+/* -------------------------------------------------------------------------- */
+
+/* Pairs first … first+n‑1, computed 64 at a time */
+static void oracle_fill(const DataSource* src, uint64_t first, size_t n, Pair* out)
+{
+    int64_t groups = (int64_t)((n + BS_LANES - 1) / BS_LANES);
+    int64_t g = 0;
+
+#pragma omp parallel for schedule(static) if (groups > 1 && !omp_in_parallel())
+    for (g = 0; g < groups; ++g) {
+        uint64_t pt[BS_LANES], ct[BS_LANES];
+        size_t base = (size_t)g * BS_LANES;
+
+        for (int l = 0; l < BS_LANES; ++l)
+            pt[l] = generate_plaintext(src->seed, first + base + l);
+        bs_encrypt64(pt, &src->bks, ct);
+        for (size_t l = 0; l < BS_LANES && base + l < n; ++l) {
+            out[base + l].plaintext = pt[l];
+            out[base + l].ciphertext = ct[l];
+        }
+    }
+}
+
+/* Ciphertexts straight into the upper half of `out`, then spread into Pairs */
+static size_t read_ct(DataSource* src, uint64_t first, size_t n, Pair* out)
+{
+    uint64_t* ct = (uint64_t*)(out + n) - n;
+    size_t got = src_pread(src, ct, n * sizeof(uint64_t), first * sizeof(uint64_t)) / sizeof(uint64_t);
+
+    /* ct[i] sits at or above out[i], so a forward pass never overwrites unread input */
+    for (size_t i = 0; i < got; ++i) {
+        uint64_t c = ct[i];
+        out[i].plaintext = generate_plaintext(src->seed, first + i);
+        out[i].ciphertext = c;
+    }
+    return got;
+}
+
+/* Up to n pairs out of `nblk` PackedBlocks, starting at lane `skip` of the first */
+static size_t unpack_blocks(const PackedBlock* blk, size_t nblk, size_t skip, size_t n, Pair* out)
+{
+    size_t done = 0;
+    for (size_t k = 0; k < nblk && done < n; ++k) {
+        for (size_t l = skip; l < BS_LANES && done < n; ++l, ++done) {
+            out[done].plaintext = (((blk[k].p16 >> l) & 1) << 16) | (((blk[k].p48 >> l) & 1) << 48);
+            out[done].ciphertext = blk[k].ct[l];
+        }
+        skip = 0;
+    }
+    return done;
+}
+
+static size_t read_packed(DataSource* src, uint64_t first, size_t n, Pair* out)
+{
+    PackedBlock blk[PACKED_READ_BLOCKS];
+    uint64_t b = first / BS_LANES;
+    size_t skip = (size_t)(first % BS_LANES);
+    size_t done = 0;
+
+    while (done < n) {
+        size_t want = (skip + (n - done) + BS_LANES - 1) / BS_LANES;
+        if (want > PACKED_READ_BLOCKS)
+            want = PACKED_READ_BLOCKS;
+        size_t got = src_pread(src, blk, want * sizeof(PackedBlock), b * sizeof(PackedBlock))
+            / sizeof(PackedBlock);
+        if (!got)
+            break;
+
+        done += unpack_blocks(blk, got, skip, n - done, out + done);
+        skip = 0;
+        b += got;
+    }
+    return done;
+}
+
+/* Whole pairs from all 128 planes: read a run of words per plane, transpose back */
+static size_t read_planes(DataSource* src, uint64_t first, size_t n, Pair* out)
+{
+    uint64_t* w = malloc(sizeof(uint64_t) * DATA_PLANES * PLANE_READ_WORDS);
+    if (!w)
+        return 0;
+
+    uint64_t word = first / BS_LANES;
+    size_t skip = (size_t)(first % BS_LANES);
+    size_t done = 0;
+
+    while (done < n) {
+        size_t want = (skip + (n - done) + BS_LANES - 1) / BS_LANES;
+        if (want > PLANE_READ_WORDS)
+            want = PLANE_READ_WORDS;
+        size_t got = want;
+        for (int b = 0; b < DATA_PLANES; ++b) {
+            size_t g = data_source_read_plane(src, b, word, want, w + (size_t)b * PLANE_READ_WORDS);
+            if (g < got)
+                got = g;
+        }
+        if (!got)
+            break;
+
+        for (size_t k = 0; k < got && done < n; ++k) {
+            uint64_t pt[BS_LANES], ct[BS_LANES];
+            for (int b = 0; b < 64; ++b) {
+                pt[b] = w[(size_t)DATA_PLANE_P(b) * PLANE_READ_WORDS + k];
+                ct[b] = w[(size_t)DATA_PLANE_C(b) * PLANE_READ_WORDS + k];
+            }
+            /* row b = bit b of every lane  →  row l = lane l */
+            bs_transpose64(pt);
+            bs_transpose64(ct);
+            for (size_t l = skip; l < BS_LANES && done < n; ++l, ++done) {
+                out[done].plaintext = pt[l];
+                out[done].ciphertext = ct[l];
+            }
+            skip = 0;
+        }
+        word += got;
+    }
+    free(w);
+    return done;
+}
+
+/*
+ * A chunk of the running stream, straight out of the read‑ahead ring.
+ * Returns 0 when (first, n) is not one of its chunks or was already read.
+ */
+static size_t read_stream(DataSource* src, uint64_t first, size_t n, Pair* out)
+{
+    if (first < src->stream_first || (first - src->stream_first) % src->stream_chunk)
+        return 0;
+
+    uint64_t index = (first - src->stream_first) / src->stream_chunk;
+    size_t len = 0, got = 0;
+    const uint8_t* raw = data_async_acquire(src->async, index, &len);
+    if (!raw)
+        return 0;
+
+    if (src->format == DATA_FORMAT_PACKED) {
+        got = unpack_blocks((const PackedBlock*)raw, len / sizeof(PackedBlock), 0, n, out);
+    }
+    else if (src->format == DATA_FORMAT_CT) {
+        got = len / sizeof(uint64_t) < n ? len / sizeof(uint64_t) : n;
+        for (size_t i = 0; i < got; ++i) {
+            uint64_t c;
+            memcpy(&c, raw + i * sizeof(uint64_t), sizeof(c));
+            out[i].plaintext = generate_plaintext(src->seed, first + i);
+            out[i].ciphertext = c;
+        }
+    }
+    else {
+        got = len / sizeof(Pair) < n ? len / sizeof(Pair) : n;
+        memcpy(out, raw, got * sizeof(Pair));
+    }
+    data_async_release(src->async, index);
+    return got;
+}
+
+static size_t read_file(DataSource* src, uint64_t first, size_t n, Pair* out)
+{
+    if (src->format == DATA_FORMAT_PACKED)
+        return read_packed(src, first, n, out);
+    if (src->format == DATA_FORMAT_CT)
+        return read_ct(src, first, n, out);
+    if (src->format == DATA_FORMAT_PLANES)
+        return read_planes(src, first, n, out);
+    return src_pread(src, out, n * sizeof(Pair), first * sizeof(Pair)) / sizeof(Pair);
+}
+
+size_t data_source_read(DataSource* src, uint64_t first, size_t n, Pair* out)
+{
+    if (first >= src->pairs)
+        return 0;
+    if (src->pairs - first < n)
+        n = (size_t)(src->pairs - first);
+
+    if (src->kind == DATA_SOURCE_ORACLE) {
+        oracle_fill(src, first, n, out);
+        return n;
+    }
+    if (src->async) {
+        size_t got = read_stream(src, first, n, out);
+        if (got)
+            return got < n ? got + read_file(src, first + got, n - got, out + got) : got;
+    }
+    return read_file(src, first, n, out);
+}
+
+size_t data_source_view(DataSource* src, uint64_t first, size_t n, const Pair** out)
+{
+    if (src->kind != DATA_SOURCE_FILE || src->reader != DATA_READER_MMAP
+        || src->format != DATA_FORMAT_PAIR || first >= src->pairs)
+        return 0;
+    if (src->pairs - first < n)
+        n = (size_t)(src->pairs - first);
+
+    /* a view cannot span two members */
+    uint64_t at, room;
+    DataFile* f = record_locate(&src->file, src->member, src->stripes, src->stripe_bytes,
+        first * sizeof(Pair), &at, &room);
+    if (room < n * sizeof(Pair))
+        return 0;
+    *out = (const Pair*)data_file_view(f, at, n * sizeof(Pair));
+    return *out ? n : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Streaming                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * DataReadFn over the unbuffered handles.  Offsets are file offsets for a
+ * single file (alignment is about the file, header included) and record
+ * offsets for stripes (every member starts with a stripe boundary).
+ */
+static uint64_t stream_base(const DataSource* src)
+{
+    return src->stripes ? 0 : DATA_HEADER_BYTES;
+}
+
+static size_t stream_read(void* ctx, void* buf, size_t len, uint64_t offset)
+{
+    DataSource* src = (DataSource*)ctx;
+    return record_pread(&src->direct[0], src->direct, src->stripes, src->stripe_bytes,
+        buf, len, offset - stream_base(src));
+}
+
+void data_source_stream(DataSource* src, uint64_t first, uint64_t count, size_t chunk)
+{
+    data_source_stream_end(src);
+    if (src->reader != DATA_READER_ASYNC || first >= src->pairs || !chunk)
+        return;
+    if (src->pairs - first < count)
+        count = src->pairs - first;
+
+    /* one I/O thread per member keeps every disk busy */
+    int depth = ASYNC_DEPTH_PER_THREAD * omp_get_max_threads() + ASYNC_DEPTH_EXTRA;
+    src->async = data_async_start(stream_read, src,
+        stream_base(src) + data_format_bytes(src->format, first),
+        data_format_bytes(src->format, count),
+        (size_t)data_format_bytes(src->format, chunk), depth,
+        src->stripes ? src->stripes : 1);
+    src->stream_first = first;
+    src->stream_chunk = chunk;
+}
+
+void data_source_stream_end(DataSource* src)
+{
+    if (src->async) {
+        data_async_stop(src->async);
+        src->async = NULL;
+    }
+}
+
+size_t data_source_read_plane(DataSource* src, int plane, uint64_t first_word, size_t nwords, uint64_t* out)
+{
+    if (src->kind != DATA_SOURCE_FILE || src->format != DATA_FORMAT_PLANES)
+        return 0;
+    return data_file_pread(&src->plane[plane], out, nwords * sizeof(uint64_t),
+        first_word * sizeof(uint64_t)) / sizeof(uint64_t);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Write                                                                     */
+/* -------------------------------------------------------------------------- */
+
+int data_sink_open(DataSink* sink, const char* path, const DataHeader* hdr, uint64_t keep,
+    const DataStripes* stripes)
+{
+    int format = (int)hdr->format;
+    int mode = keep ? DATA_FILE_UPDATE : DATA_FILE_WRITE;
+    uint64_t bytes = data_format_bytes(format, hdr->pairs);
+
+    memset(sink, 0, sizeof(*sink));
+    sink->hdr = *hdr;
+    if (hdr->stripes && (!stripes || stripes->count != (int)hdr->stripes
+        || stripes->pairs != hdr->stripe_pairs || format == DATA_FORMAT_PLANES))
+        return 0;
+    if (!data_file_open(&sink->file, path, mode))
+        return 0;
+
+    /*
+     * Until data_sink_commit() the header on disk still describes only the
+     * `keep` pairs that were there before, so a crash never leaves a header
+     * that promises pairs which were not written.
+     */
+    DataHeader pending = *hdr;
+    pending.pairs = keep;
+    int ok = data_file_pwrite(&sink->file, &pending, sizeof(pending), 0);
+
+    if (format == DATA_FORMAT_PLANES) {
+        ok = ok && data_file_resize(&sink->file, DATA_HEADER_BYTES);
+        if (ok && open_planes(sink->plane, path, mode)) {
+            for (int b = 0; b < DATA_PLANES && ok; ++b)
+                ok = data_file_resize(&sink->plane[b], bytes);
+            if (!ok)
+                close_planes(sink->plane);
+        }
+        else {
+            ok = 0;
+        }
+    }
+    else if (hdr->stripes) {
+        /* header + member table here, the records in the members */
+        int n = (int)hdr->stripes;
+        sink->stripe_bytes = data_format_bytes(format, hdr->stripe_pairs);
+        ok = ok && data_file_pwrite(&sink->file, stripes->path, (size_t)n * DATA_PATH_MAX, DATA_HEADER_BYTES)
+            && data_file_resize(&sink->file, DATA_HEADER_BYTES + (uint64_t)n * DATA_PATH_MAX);
+        if (ok && open_members(sink->member, stripes, mode)) {
+            for (int m = 0; m < n && ok; ++m)
+                ok = data_file_resize(&sink->member[m], member_bytes(bytes, n, sink->stripe_bytes, m));
+            if (!ok)
+                close_members(sink->member, n);
+        }
+        else {
+            ok = 0;
+        }
+    }
+    else {
+        ok = ok && data_file_resize(&sink->file, DATA_HEADER_BYTES + bytes);
+    }
+
+    if (!ok)
+        data_file_close(&sink->file);
+    return ok;
+}
+
+int data_sink_commit(DataSink* sink)
+{
+    return data_file_pwrite(&sink->file, &sink->hdr, sizeof(sink->hdr), 0);
+}
+
+void data_sink_close(DataSink* sink)
+{
+    if (sink->hdr.format == DATA_FORMAT_PLANES)
+        close_planes(sink->plane);
+    close_members(sink->member, (int)sink->hdr.stripes);
+    data_file_close(&sink->file);
+}
+
+/* 64‑pair groups → one word per plane, plane‑major: w[b · words + g] */
+static void encode_planes(const Pair* in, size_t words, uint64_t* w)
+{
+    for (size_t g = 0; g < words; ++g, in += BS_LANES) {
+        uint64_t pt[BS_LANES], ct[BS_LANES];
+        for (int l = 0; l < BS_LANES; ++l) {
+            pt[l] = in[l].plaintext;
+            ct[l] = in[l].ciphertext;
+        }
+        bs_transpose64(pt);
+        bs_transpose64(ct);
+        for (int b = 0; b < 64; ++b) {
+            w[(size_t)DATA_PLANE_P(b) * words + g] = pt[b];
+            w[(size_t)DATA_PLANE_C(b) * words + g] = ct[b];
+        }
+    }
+}
+
+static void encode_packed(const Pair* in, size_t n, PackedBlock* blk)
+{
+    for (size_t b = 0; b < n / BS_LANES; ++b, in += BS_LANES) {
+        uint64_t p16 = 0, p48 = 0;
+        for (int l = 0; l < BS_LANES; ++l) {
+            blk[b].ct[l] = in[l].ciphertext;
+            p16 |= ((in[l].plaintext >> 16) & 1) << l;
+            p48 |= ((in[l].plaintext >> 48) & 1) << l;
+        }
+        blk[b].p16 = p16;
+        blk[b].p48 = p48;
+    }
+}
+
+int data_sink_write(DataSink* sink, uint64_t first, size_t n, const Pair* in)
+{
+    int format = (int)sink->hdr.format;
+    int stripes = (int)sink->hdr.stripes;
+    uint64_t offset = data_format_bytes(format, first);
+    size_t bytes = (size_t)data_format_bytes(format, n);
+
+    if (format == DATA_FORMAT_PAIR)
+        return record_pwrite(&sink->file, sink->member, stripes, sink->stripe_bytes, in, bytes, offset);
+
+    void* enc = malloc(format == DATA_FORMAT_PLANES ? bytes * DATA_PLANES : bytes);
+    if (!enc)
+        return 0;
+
+    int ok = 1;
+    if (format == DATA_FORMAT_PLANES) {
+        uint64_t* w = (uint64_t*)enc;
+        size_t words = n / BS_LANES;
+        encode_planes(in, words, w);
+        for (int b = 0; b < DATA_PLANES && ok; ++b)
+            ok = data_file_pwrite(&sink->plane[b], w + (size_t)b * words, bytes, offset);   /* planes have no header */
+    }
+    else {
+        if (format == DATA_FORMAT_PACKED) {
+            encode_packed(in, n, (PackedBlock*)enc);
+        }
+        else {
+            uint64_t* ct = (uint64_t*)enc;
+            for (size_t i = 0; i < n; ++i)
+                ct[i] = in[i].ciphertext;
+        }
+        ok = record_pwrite(&sink->file, sink->member, stripes, sink->stripe_bytes, enc, bytes, offset);
+    }
+    free(enc);
+    return ok;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  End of file                                                               */
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,387 @@
+﻿#pragma once
+
+// dataset_source.h — where the attack gets its (P,C) pairs from
+
+#ifndef DATASET_SOURCE_H
+#define DATASET_SOURCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MGFN_18R.h"           /* KeySchedule, Pair */
+#include "MGFN_18R_bitslice.h"  /* BitslicedKeySchedule */
+#include "dataset_io.h"         /* DataFile */
+#include "dataset_async.h"      /* DataAsync */
+
+    /* -------------------------------------------------------------------------- */
+    /*  Public constants                                                          */
+    /* -------------------------------------------------------------------------- */
+
+#define DATA_SOURCE_FILE    0   /* pairs read back from a dataset file         */
+#define DATA_SOURCE_ORACLE  1   /* pairs regenerated from (seed, index) on read */
+
+    /* On‑disk encodings (the attack only ever looks at P bits 16 and 48) */
+#define DATA_FORMAT_PAIR    0   /* Pair records, 16 bytes per pair                  */
+#define DATA_FORMAT_PACKED  1   /* PackedBlock of 64 pairs, 8.25 bytes per pair     */
+#define DATA_FORMAT_CT      2   /* ciphertext only, 8 bytes; P implied by the seed  */
+#define DATA_FORMAT_PLANES  3   /* one file per bit position, 1 bit per pair each   */
+
+    /* Plaintext bits that survive DATA_FORMAT_PACKED (all others read as 0) */
+#define DATA_PACKED_P_MASK  ((1ULL << 48) | (1ULL << 16))
+
+    /* Self‑describing header at offset 0 of every dataset (DataHeader) */
+#define DATA_HEADER_MAGIC   "MGFNDSET"
+#define DATA_HEADER_VERSION 2   /* 2: stripe fields (zero in version‑1 files) */
+#define DATA_HEADER_BYTES   64
+
+    /*
+     * Striping: the records of a pair / packed / ct dataset can be spread over
+     * up to DATA_STRIPES_MAX member files, typically one per disk.  Stripes
+     * are multiples of DATA_STRIPE_UNIT pairs, which keeps every stripe of
+     * every format a multiple of DATA_FILE_ALIGN bytes.
+     */
+#define DATA_STRIPES_MAX    16
+#define DATA_STRIPE_UNIT    16384
+#define DATA_PATH_MAX       512     /* member path slot after the header */
+
+    /* How a file source fetches its bytes (data_source_set_reader) */
+#define DATA_READER_PREAD   0   /* positional reads by the calling thread           */
+#define DATA_READER_MMAP    1   /* memory‑mapped; pair records used in place        */
+#define DATA_READER_ASYNC   2   /* unbuffered reads ahead on a dedicated I/O thread */
+
+    /* Bit planes: plane b < 64 is P bit b, plane 64 + b is C bit b */
+#define DATA_PLANES         128
+#define DATA_PLANE_P(b)     (b)
+#define DATA_PLANE_C(b)     (64 + (b))
+
+    /* -------------------------------------------------------------------------- */
+    /*  Data structures                                                           */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * First DATA_HEADER_BYTES of a dataset.  Single‑file formats keep their
+     * records right after it; for DATA_FORMAT_PLANES the file at `path`
+     * holds only the header and the planes live in "<path>.p00" … "<path>.c63".
+     * A striped dataset (stripes > 0) keeps only the header and a table of
+     * `stripes` member paths, DATA_PATH_MAX bytes each, in `path`.
+     * `pairs` counts pairs that are completely written, so an interrupted or
+     * shorter run leaves a valid prefix that the next run can extend.
+     */
+    typedef struct {
+        char     magic[8];      /* DATA_HEADER_MAGIC                      */
+        uint32_t version;       /* DATA_HEADER_VERSION                    */
+        uint32_t format;        /* DATA_FORMAT_*                          */
+        uint64_t pairs;         /* pairs present                          */
+        uint64_t seed;          /* plaintext stream seed                  */
+        uint64_t key_fp;        /* data_key_fingerprint() of the key      */
+        uint32_t stripes;       /* member files, 0 = not striped          */
+        uint32_t reserved0;
+        uint64_t stripe_pairs;  /* pairs per stripe                       */
+        uint8_t  reserved[DATA_HEADER_BYTES - 56];
+    } DataHeader;
+
+    /*
+     * Member files of a striped dataset: stripe k (pairs k·pairs …) is stored
+     * in path[k mod count] at offset (k / count) · data_format_bytes(pairs).
+     */
+    typedef struct {
+        int      count;         /* 0 = records follow the header          */
+        uint64_t pairs;         /* pairs per stripe                       */
+        char     path[DATA_STRIPES_MAX][DATA_PATH_MAX];
+    } DataStripes;
+
+    /*
+     * DATA_FORMAT_PACKED unit: 64 ciphertexts followed by the two plaintext
+     * bits the approximations use, one bit per pair (bit l ↔ ct[l]).
+     */
+    typedef struct {
+        uint64_t ct[BS_LANES];
+        uint64_t p16;
+        uint64_t p48;
+    } PackedBlock;
+
+    /*
+     * Random‑access view of the dataset.  Pair k is the same in both modes:
+     * the file written by generate_dataset() holds exactly what the oracle
+     * computes, P_k = generate_plaintext(seed, k) and C_k = encrypt(P_k),
+     * except that a DATA_FORMAT_PACKED file keeps only DATA_PACKED_P_MASK of P.
+     *
+     * A DATA_FORMAT_PLANES dataset is the transposed layout: word w of plane
+     * file b holds bit b of pairs 64w … 64w+63 (bit l ↔ pair 64w+l), so a
+     * stage can read just the planes its approximation references.
+     */
+    typedef struct {
+        int      kind;       /* DATA_SOURCE_*                         */
+        int      format;     /* DATA_FORMAT_* (file sources)          */
+        uint64_t pairs;      /* number of pairs available             */
+        DataFile file;       /* DATA_SOURCE_FILE                      */
+        DataFile plane[DATA_PLANES]; /* DATA_FORMAT_PLANES            */
+        uint64_t seed;       /* oracle and DATA_FORMAT_CT plaintexts  */
+        uint64_t key_fp;     /* data_key_fingerprint() of the key     */
+        BitslicedKeySchedule bks;
+        int      stripes;    /* member files, 0 = records in `file`   */
+        uint64_t stripe_bytes;
+        DataFile member[DATA_STRIPES_MAX];
+        int      reader;     /* DATA_READER_*                         */
+        DataFile direct[DATA_STRIPES_MAX]; /* DATA_READER_ASYNC: unbuffered handles */
+        DataAsync* async;    /* running data_source_stream()          */
+        uint64_t stream_first;
+        size_t   stream_chunk;
+    } DataSource;
+
+    /* Write side of a file‑backed dataset (see data_sink_write). */
+    typedef struct {
+        DataHeader hdr;      /* committed by data_sink_commit()       */
+        DataFile file;       /* header (+ records unless planes)      */
+        DataFile plane[DATA_PLANES];
+        uint64_t stripe_bytes;
+        DataFile member[DATA_STRIPES_MAX]; /* hdr.stripes > 0       */
+    } DataSink;
+
+    /* -------------------------------------------------------------------------- */
+    /*  API – reading                                                             */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * File‑backed source; format, pair count and seed come from the header.
+     * `reader` picks the backend (DATA_READER_*): DATA_READER_MMAP works for
+     * every format, DATA_READER_ASYNC for the single‑file formats; where the
+     * backend is unavailable the source falls back to DATA_READER_PREAD
+     * (src->reader tells which one is in use).  Returns 1 on success, 0 if
+     * the file (or, for planes, any plane file) cannot be opened or carries
+     * no valid header.
+     */
+    int data_source_open_file(
+        DataSource* src,
+        const char* path,
+        int reader
+    );
+
+    /* In‑memory source of `pairs` pairs; nothing is ever written to disk. */
+    void data_source_open_oracle(
+        DataSource* src,
+        const KeySchedule* ks,
+        uint64_t seed,
+        uint64_t pairs
+    );
+
+    void data_source_close(
+        DataSource* src
+    );
+
+    /*
+     * Fills out[0 … n‑1] with pairs first … first+n‑1 and returns how many were
+     * available (fewer only at the end of the source).  Safe to call from
+     * several threads at once; an oracle read started outside a parallel
+     * region spreads the encryption over the OpenMP team.
+     */
+    size_t data_source_read(
+        DataSource* src,
+        uint64_t first,
+        size_t n,
+        Pair* out
+    );
+
+    /*
+     * DATA_FORMAT_PLANES only: reads words first_word … first_word+nwords‑1 of
+     * one plane (DATA_PLANE_P / DATA_PLANE_C) and returns the word count.
+     */
+    size_t data_source_read_plane(
+        DataSource* src,
+        int plane,
+        uint64_t first_word,
+        size_t nwords,
+        uint64_t* out
+    );
+
+    /*
+     * Announces a scan of pairs first … first+count‑1 in `chunk`‑pair reads
+     * (chunk a multiple of 64).  With DATA_READER_ASYNC the I/O thread starts
+     * reading ahead, and data_source_read() calls for exactly those chunks
+     * are served from the ring; each chunk must then be read exactly once,
+     * in roughly increasing order.  Other readers ignore it.
+     */
+    void data_source_stream(
+        DataSource* src,
+        uint64_t first,
+        uint64_t count,
+        size_t chunk
+    );
+
+    void data_source_stream_end(
+        DataSource* src
+    );
+
+    /*
+     * Zero‑copy read: for a mapped DATA_FORMAT_PAIR source, points *out at
+     * pairs first … first+n‑1 inside the mapping and returns how many are
+     * available.  Returns 0 (and reads nothing) for every other source.
+     */
+    size_t data_source_view(
+        DataSource* src,
+        uint64_t first,
+        size_t n,
+        const Pair** out
+    );
+
+    /* "file (packed)", "oracle", … */
+    const char* data_source_name(
+        const DataSource* src
+    );
+
+    /* -------------------------------------------------------------------------- */
+    /*  API – writing                                                             */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * Opens the dataset described by `hdr` (hdr->pairs already rounded with
+     * data_format_round) and pre‑sizes every file, so chunks can then be
+     * written in any order.  The first `keep` pairs of an existing compatible
+     * dataset are preserved; keep = 0 recreates it.  For a striped dataset
+     * (hdr->stripes > 0) `stripes` names the member files, which must match
+     * hdr.  Returns 1 on success.
+     */
+    int data_sink_open(
+        DataSink* sink,
+        const char* path,
+        const DataHeader* hdr,
+        uint64_t keep,
+        const DataStripes* stripes
+    );
+
+    /*
+     * Stores pairs first … first+n‑1.  Thread‑safe for disjoint ranges; for
+     * the packed and plane formats `first` and `n` must be multiples of 64.
+     * Returns 1 on success.
+     */
+    int data_sink_write(
+        DataSink* sink,
+        uint64_t first,
+        size_t n,
+        const Pair* in
+    );
+
+    /* Writes the header, marking all hdr.pairs pairs as present.  Returns 1 on success. */
+    int data_sink_commit(
+        DataSink* sink
+    );
+
+    void data_sink_close(
+        DataSink* sink
+    );
+
+    /* -------------------------------------------------------------------------- */
+    /*  API – header                                                              */
+    /* -------------------------------------------------------------------------- */
+
+    void data_header_init(
+        DataHeader* hdr,
+        int format,
+        uint64_t pairs,
+        uint64_t seed,
+        uint64_t key_fp
+    );
+
+    /* Reads and validates the header of `path`.  Returns 1 if it is a dataset. */
+    int data_header_read(
+        const char* path,
+        DataHeader* hdr
+    );
+
+    /*
+     * 1 when `have` holds a prefix of the dataset `want` describes: same
+     * format, seed, key and stripe layout, so its pairs can be kept and
+     * extended (callers also compare the member paths, data_stripes_read).
+     */
+    int data_header_compatible(
+        const DataHeader* have,
+        const DataHeader* want
+    );
+
+    /*
+     * Member paths "<dir>/<name of path>.s00", … for the comma‑separated
+     * directory list `dirs`, stripe_pairs per stripe (a multiple of
+     * DATA_STRIPE_UNIT).  Returns 0 if the list is empty, too long, or a path
+     * does not fit.
+     */
+    int data_stripes_init(
+        DataStripes* st,
+        const char* path,
+        const char* dirs,
+        uint64_t stripe_pairs
+    );
+
+    /* Member table of the striped dataset at `path` (count = 0 if not striped).  Returns 1 on success. */
+    int data_stripes_read(
+        const char* path,
+        const DataHeader* hdr,
+        DataStripes* st
+    );
+
+    /* 1 when both describe the same member files and stripe size */
+    int data_stripes_equal(
+        const DataStripes* a,
+        const DataStripes* b
+    );
+
+    /* 64‑bit digest of the round keys: tells datasets of different keys apart. */
+    uint64_t data_key_fingerprint(
+        const KeySchedule* ks
+    );
+
+    /* -------------------------------------------------------------------------- */
+    /*  API – on‑disk formats                                                     */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * Bytes taken by the first `pairs` pairs, i.e. the file offset of pair
+     * `pairs` (per plane file for DATA_FORMAT_PLANES).
+     */
+    uint64_t data_format_bytes(
+        int format,
+        uint64_t pairs
+    );
+
+    /*
+     * Pairs a format stores in whole units: packed and plane datasets always
+     * hold a multiple of 64, so writers round their pair count up to this.
+     */
+    uint64_t data_format_round(
+        int format,
+        uint64_t pairs
+    );
+
+    /* Plane file name: "<path>.p16", "<path>.c48", … */
+    void data_plane_path(
+        char* out,
+        size_t cap,
+        const char* path,
+        int plane
+    );
+
+    /* "pair" / "packed" / "ct" / "planes" ↔ DATA_FORMAT_*; parse returns ‑1 if unknown. */
+    const char* data_format_name(
+        int format
+    );
+
+    int data_format_parse(
+        const char* name
+    );
+
+    /* "pread" / "mmap" / "async" ↔ DATA_READER_*; parse returns ‑1 if unknown. */
+    const char* data_reader_name(
+        int reader
+    );
+
+    int data_reader_parse(
+        const char* name
+    );
+
+    /* -------------------------------------------------------------------------- */
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* DATASET_SOURCE_H */
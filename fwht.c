@@ -0,0 +1,75 @@
+﻿/*-----------------------------------------------------------------------------
+ * fwht.c — joint key‑guess correlations through the Walsh–Hadamard transform
+ * ---------------------------------------------------------------------------
+ * The correlation of guess key is an XOR convolution of the counter table a
+ * with the sign kernel K(u) = Π_i (−1)^(g_i(u_i)):
+ *   corr[key] = Σ_z a[z] · K(z ^ key),   so   H(corr) = H(a) · H(K)
+ * and corr = H(H(a) · H(K)) / 2^k.  K is a product over nibbles, hence H(K)
+ * is the product of the 16‑point transforms of the g_i, read nibble by
+ * nibble.  Everything is integer: H(a)·H(K) is exactly 2^k·H(corr), so the
+ * final division is exact, and wrapping butterflies keep the result right
+ * whenever it fits in 64 bits (|corr| ≤ number of pairs).
+ *----------------------------------------------------------------------------*/
+
+#include <stddef.h>
+
+#include "fwht.h"
+
+/* -------------------------------------------------------------------------- */
+/*  Transform                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void fwht_transform(int64_t* a, int k)
+{
+    uint64_t* u = (uint64_t*)a;
+    size_t n = (size_t)1 << k;
+
+    for (size_t h = 1; h < n; h <<= 1) {
+        for (size_t i = 0; i < n; i += 2 * h) {
+            for (size_t j = i; j < i + h; ++j) {
+                uint64_t x = u[j], y = u[j + h];
+                u[j] = x + y;
+                u[j + h] = x - y;
+            }
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Correlations                                                              */
+/* -------------------------------------------------------------------------- */
+
+int fwht_correlate(int64_t* a, int nnib, const uint16_t g[])
+{
+    if (nnib < 1 || nnib > FWHT_MAX_NIBS)
+        return 0;
+
+    /* 16‑point transform of each nibble's sign function */
+    int64_t hk[FWHT_MAX_NIBS][16];
+    for (int i = 0; i < nnib; ++i) {
+        for (int v = 0; v < 16; ++v)
+            hk[i][v] = ((g[i] >> v) & 1) ? -1 : 1;
+        fwht_transform(hk[i], 4);
+    }
+
+    int k = 4 * nnib;
+    size_t n = (size_t)1 << k;
+    uint64_t* u = (uint64_t*)a;
+
+    fwht_transform(a, k);
+    for (size_t w = 0; w < n; ++w) {
+        uint64_t m = 1;
+        for (int i = 0; i < nnib; ++i)
+            m *= (uint64_t)hk[i][(w >> (4 * i)) & 0xF];
+        u[w] *= m;
+    }
+    fwht_transform(a, k);
+
+    for (size_t w = 0; w < n; ++w)
+        a[w] /= (int64_t)n;
+    return 1;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  End of file                                                               */
+/* -------------------------------------------------------------------------- */
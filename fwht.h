@@ -0,0 +1,54 @@
+﻿#pragma once
+
+// fwht.h — fast Walsh–Hadamard scoring of joint nibble key guesses
+
+#ifndef FWHT_H
+#define FWHT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+    /* -------------------------------------------------------------------------- */
+    /*  Limits                                                                    */
+    /* -------------------------------------------------------------------------- */
+
+#define FWHT_MAX_NIBS   4     /* guessed nibbles per table: k = 4·nnib ≤ 16    */
+
+    /* -------------------------------------------------------------------------- */
+    /*  API                                                                       */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * In‑place Walsh–Hadamard transform of 2^k values (unnormalised).  The
+     * butterflies wrap modulo 2^64, so any result that fits in int64_t is
+     * exact even when intermediate sums do not.
+     */
+    void fwht_transform(
+        int64_t* a,
+        int k
+    );
+
+    /*
+     * Correlation of every joint key guess from a signed counter table.
+     * Index z of a holds nnib nibbles, nibble i at bits 4i..4i+3, and a[z] is
+     * (#pairs with parity 0) − (#pairs with parity 1) of the key‑independent
+     * part.  Guessed nibble i contributes the bit g[i] >> (z_i ^ key_i), so
+     * on return
+     *   a[key] = Σ_z a[z] · Π_i (−1)^((g[i] >> (z_i ^ key_i)) & 1)
+     * for all 2^(4·nnib) keys, in O(k·2^k) instead of O(4^k).
+     * Returns 0 if nnib is out of range.
+     */
+    int fwht_correlate(
+        int64_t* a,
+        int nnib,
+        const uint16_t g[]
+    );
+
+    /* -------------------------------------------------------------------------- */
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* FWHT_H */
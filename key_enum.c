@@ -0,0 +1,184 @@
+﻿/*-----------------------------------------------------------------------------
+ * key_enum.c — likelihood‑ordered enumeration of combined key candidates
+ * ---------------------------------------------------------------------------
+ * Each list is sorted best first, so a combination is an index vector
+ * (i_0, …, i_{n‑1}) and its score is the sum of the list scores.  Starting
+ * from (0, …, 0), the children of a vector whose last non‑zero index is L
+ * are the vectors with one index j ≥ L incremented.  Every vector has
+ * exactly one parent (decrement its last non‑zero index) and scores never
+ * grow from parent to child, so popping the best vector from a max‑heap and
+ * pushing its children yields all combinations once, in descending score.
+ * A list led by a lower‑scored entry (a decided key) still yields each
+ * combination once, starting from (0, …, 0); only that entry's children may
+ * then outscore it.  After k outputs the heap holds at most k·n + 1 vectors.
+ *----------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "key_enum.h"
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+    double  score;
+    int     last;                    /* highest list index that is non‑zero */
+    uint8_t idx[KEY_ENUM_LISTS];
+} EnumNode;
+
+struct KeyEnum {
+    KeyRanking lists[KEY_ENUM_LISTS];
+    int        nlists;
+    EnumNode*  heap;
+    size_t     size;
+    size_t     cap;
+};
+
+/* -------------------------------------------------------------------------- */
+/*  Rankings                                                                  */
+/* -------------------------------------------------------------------------- */
+
+void key_ranking_init(KeyRanking* r, const double score[KEY_ENUM_VALUES])
+{
+    r->n = KEY_ENUM_VALUES;
+    for (int i = 0; i < KEY_ENUM_VALUES; ++i) {
+        /* insertion sort; strict comparison keeps ties in value order */
+        int j = i;
+        while (j > 0 && score[i] > r->score[j - 1]) {
+            r->value[j] = r->value[j - 1];
+            r->score[j] = r->score[j - 1];
+            --j;
+        }
+        r->value[j] = (uint8_t)i;
+        r->score[j] = score[i];
+    }
+}
+
+void key_ranking_fixed(KeyRanking* r, uint8_t value)
+{
+    memset(r, 0, sizeof(*r));
+    r->n = 1;
+    r->value[0] = value;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Heap                                                                      */
+/* -------------------------------------------------------------------------- */
+
+/* Room for `more` nodes on top of the heap's; returns 0 if memory is short */
+static int heap_reserve(KeyEnum* ke, size_t more)
+{
+    if (ke->size + more <= ke->cap)
+        return 1;
+    size_t cap = ke->cap ? 2 * ke->cap : 64;
+    while (cap < ke->size + more)
+        cap *= 2;
+    EnumNode* h = realloc(ke->heap, cap * sizeof(EnumNode));
+    if (!h)
+        return 0;
+    ke->heap = h;
+    ke->cap = cap;
+    return 1;
+}
+
+/* The caller has reserved the room */
+static void heap_push(KeyEnum* ke, const EnumNode* node)
+{
+    size_t i = ke->size++;
+    while (i > 0 && ke->heap[(i - 1) / 2].score < node->score) {
+        ke->heap[i] = ke->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    ke->heap[i] = *node;
+}
+
+static void heap_pop(KeyEnum* ke, EnumNode* top)
+{
+    *top = ke->heap[0];
+    EnumNode last = ke->heap[--ke->size];
+
+    size_t i = 0;
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= ke->size)
+            break;
+        if (c + 1 < ke->size && ke->heap[c + 1].score > ke->heap[c].score)
+            ++c;
+        if (ke->heap[c].score <= last.score)
+            break;
+        ke->heap[i] = ke->heap[c];
+        i = c;
+    }
+    if (ke->size)
+        ke->heap[i] = last;
+}
+
+/* -------------------------------------------------------------------------- */
+/*  Enumeration                                                               */
+/* -------------------------------------------------------------------------- */
+
+KeyEnum* key_enum_start(const KeyRanking* lists, int nlists)
+{
+    if (nlists < 1 || nlists > KEY_ENUM_LISTS)
+        return NULL;
+    for (int l = 0; l < nlists; ++l)
+        if (lists[l].n < 1 || lists[l].n > KEY_ENUM_VALUES)
+            return NULL;
+
+    KeyEnum* ke = calloc(1, sizeof(*ke));
+    if (!ke)
+        return NULL;
+    memcpy(ke->lists, lists, sizeof(KeyRanking) * (size_t)nlists);
+    ke->nlists = nlists;
+
+    EnumNode root;
+    memset(&root, 0, sizeof(root));
+    for (int l = 0; l < nlists; ++l)
+        root.score += lists[l].score[0];
+    if (!heap_reserve(ke, 1)) {
+        free(ke);
+        return NULL;
+    }
+    heap_push(ke, &root);
+    return ke;
+}
+
+int key_enum_next(KeyEnum* ke, uint8_t* values, double* score)
+{
+    if (!ke->size)
+        return 0;
+    /* room for every child before the parent leaves, so a short allocation loses nothing */
+    if (!heap_reserve(ke, (size_t)ke->nlists))
+        return -1;
+
+    EnumNode node;
+    heap_pop(ke, &node);
+
+    for (int j = node.last; j < ke->nlists; ++j) {
+        const KeyRanking* r = &ke->lists[j];
+        if (node.idx[j] + 1 >= r->n)
+            continue;
+        EnumNode child = node;
+        child.idx[j]++;
+        child.last = j;
+        child.score += r->score[child.idx[j]] - r->score[node.idx[j]];
+        heap_push(ke, &child);
+    }
+
+    for (int l = 0; l < ke->nlists; ++l)
+        values[l] = ke->lists[l].value[node.idx[l]];
+    *score = node.score;
+    return 1;
+}
+
+void key_enum_stop(KeyEnum* ke)
+{
+    if (!ke)
+        return;
+    free(ke->heap);
+    free(ke);
+}
+
+/* -------------------------------------------------------------------------- */
+/*  End of file                                                               */
+/* -------------------------------------------------------------------------- */
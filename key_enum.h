@@ -0,0 +1,88 @@
+﻿#pragma once
+
+// key_enum.h — key candidates ranked per nibble, enumerated jointly by likelihood
+
+#ifndef KEY_ENUM_H
+#define KEY_ENUM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+    /* -------------------------------------------------------------------------- */
+    /*  Data structures                                                           */
+    /* -------------------------------------------------------------------------- */
+
+#define KEY_ENUM_VALUES   16    /* candidates per list (one nibble)            */
+#define KEY_ENUM_LISTS    32    /* independent lists per enumeration           */
+
+    /*
+     * The candidates of one key nibble, best first: value[i] has the
+     * log‑likelihood score[i], and score is non‑increasing in i — except
+     * that value[0] may be a key decided otherwise, moved to the front with
+     * its own, lower score.  Scores of different lists add up to the score
+     * of the combined key.
+     */
+    typedef struct {
+        int     n;
+        uint8_t value[KEY_ENUM_VALUES];
+        double  score[KEY_ENUM_VALUES];
+    } KeyRanking;
+
+    /*
+     * Enumerates the combinations of one candidate per list in descending
+     * total score (best‑first search over the index vectors with a binary
+     * heap, each vector reached from a single parent, so every combination
+     * comes out exactly once and in optimal order).  The first one is always
+     * every list's value[0]; a list whose value[0] is not its best only
+     * brings the combinations through it forward.
+     */
+    typedef struct KeyEnum KeyEnum;
+
+    /* -------------------------------------------------------------------------- */
+    /*  API                                                                       */
+    /* -------------------------------------------------------------------------- */
+
+    /*
+     * Ranks 16 candidates from their scores: sorts by descending score,
+     * keeping lower values first on ties.
+     */
+    void key_ranking_init(
+        KeyRanking* r,
+        const double score[KEY_ENUM_VALUES]
+    );
+
+    /* A list with the single candidate `value` (a nibble that is not attacked) */
+    void key_ranking_fixed(
+        KeyRanking* r,
+        uint8_t value
+    );
+
+    /* Returns NULL if nlists is out of range or memory is short */
+    KeyEnum* key_enum_start(
+        const KeyRanking* lists,
+        int nlists
+    );
+
+    /*
+     * Writes the next combination (values[l] from lists[l]) and its total
+     * score.  Returns 1, 0 once every combination has been produced, or ‑1
+     * if memory is short (nothing is written and no combination is lost).
+     */
+    int key_enum_next(
+        KeyEnum* ke,
+        uint8_t* values,
+        double* score
+    );
+
+    void key_enum_stop(
+        KeyEnum* ke
+    );
+
+    /* -------------------------------------------------------------------------- */
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* KEY_ENUM_H */
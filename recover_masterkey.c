@@ -18,6 +18,7 @@
  *----------------------------------------------------------------------------*/
 
 #include "MGFN_18R.h"
+#include "MGFN_18R_bitslice.h"
 #include "recover_masterkey.h"
 #include <omp.h>
 #include <string.h>
@@ -82,6 +83,248 @@ static void unpermute_key(
     *out_l = mkl;
 }
 
+/*-------------------------------------------------------------*/
+/*  Incremental candidate generator                            */
+/*-------------------------------------------------------------*/
+/*
+ * Within one template only the 29‑bit counter i moves, and it enters the
+ * candidate linearly (hi bits 32..60, lo bits 29..57).  The S‑box windows of
+ * inverse steps 10..2 never see counter bits 0..5, so for the 64 candidates
+ * of an aligned block every key‑schedule state s_1..s_10 is the block base's
+ * state XOR a fixed linear image of j = i & 63.  A block undoes steps 10..2
+ * once; each candidate XORs in the precomputed difference and undoes only
+ * step 1.  The states visited while undoing are exactly the ones the forward
+ * key_schedule() would recompute, so round keys K_r = hi(rotr61(s_r)) are
+ * taken from them directly and combined per candidate only when a round
+ * actually asks for one.
+ */
+#define CAND_BLOCK_BITS  6
+#define CAND_BLOCK       (1 << CAND_BLOCK_BITS)
+#define BS_BIT(x, b)     (0ULL - (((x) >> (b)) & 1ULL))   /* bit b of x in every lane */
+
+static uint8_t  g_inv_sbox8[256];                           /* inv4 on both nibbles */
+static uint64_t g_ds1_hi[CAND_BLOCK], g_ds1_lo[CAND_BLOCK]; /* s_1 difference of j  */
+static uint64_t g_drk[20][CAND_BLOCK];                      /* rk[w] difference of j */
+static uint64_t g_ds1_plane[2][64];                         /* g_ds1_lo/hi as planes */
+static uint64_t g_drk_plane[20][64];                        /* g_drk as planes       */
+static uint64_t g_bit_planes[256][8];                       /* bits of a byte, 0/~0  */
+
+typedef struct {
+    uint64_t s1_hi, s1_lo;   /* state s_1 of the block base                      */
+    uint64_t rk[20];         /* rk[1..19] of the block base (rk[0] is per j)     */
+} CandidateBlock;
+
+/* 64‑bit round key of a key‑schedule state: hi(rotr61(h:l)) */
+static inline uint64_t round_key_of(uint64_t h, uint64_t l)
+{
+    return (l << 3) | (h >> 61);
+}
+
+/* One inverse key‑schedule step s_r → s_{r-1}, byte‑wide inverse S‑box */
+static inline void undo_step(uint64_t* h, uint64_t* l, int r)
+{
+    uint64_t hh = *h ^ (uint64_t)((r >> 2) & 3);
+    uint64_t ll = *l ^ ((uint64_t)(r & 3) << 62);
+    hh = (hh & 0x00FFFFFFFFFFFFFFULL) | ((uint64_t)g_inv_sbox8[hh >> 56] << 56);
+    rotl67(&hh, &ll);
+    *h = hh;
+    *l = ll;
+}
+
+/* Place K_r into the rk[] layout used by encrypt() */
+static inline void store_round_key(uint64_t rk[20], int r, uint64_t K)
+{
+    if (r == 10) {
+        rk[19] = K;
+    }
+    else {
+        rk[2 * r - 1] = K >> 32;
+        rk[2 * r] = K & 0xFFFFFFFFULL;
+    }
+}
+
+static void candidate_tables_init(void)
+{
+    for (int b = 0; b < 256; ++b)
+        g_inv_sbox8[b] = (uint8_t)((inv4((uint8_t)(b >> 4)) << 4) | inv4((uint8_t)b));
+
+    /* propagate the counter difference j through the linear part only */
+    for (int j = 0; j < CAND_BLOCK; ++j) {
+        uint64_t h = (uint64_t)j << 32, l = (uint64_t)j << 29;
+        uint64_t rk[20] = { 0 };
+        rotl61(&h, &l);
+        for (int r = 10; r >= 1; --r) {
+            store_round_key(rk, r, round_key_of(h, l));
+            if (r > 1) rotl67(&h, &l);
+        }
+        g_ds1_hi[j] = h;
+        g_ds1_lo[j] = l;
+        for (int w = 1; w < 20; ++w)
+            g_drk[w][j] = rk[w];
+    }
+
+    for (int v = 0; v < 256; ++v)
+        for (int b = 0; b < 8; ++b)
+            g_bit_planes[v][b] = BS_BIT(v, b);
+
+    /* the same differences as bit planes, lane j = candidate j */
+    memcpy(g_ds1_plane[0], g_ds1_lo, sizeof(g_ds1_lo));
+    memcpy(g_ds1_plane[1], g_ds1_hi, sizeof(g_ds1_hi));
+    bs_transpose64(g_ds1_plane[0]);
+    bs_transpose64(g_ds1_plane[1]);
+    for (int w = 1; w < 20; ++w) {
+        memcpy(g_drk_plane[w], g_drk[w], sizeof(g_drk[w]));
+        bs_transpose64(g_drk_plane[w]);
+    }
+}
+
+/* Undo steps 10..2 for the block whose counter bits 0..5 are zero */
+static void candidate_block_init(CandidateBlock* cb, uint64_t hi, uint64_t lo)
+{
+    rotl61(&hi, &lo);
+    for (int r = 10; r >= 1; --r) {
+        store_round_key(cb->rk, r, round_key_of(hi, lo));
+        if (r > 1) undo_step(&hi, &lo, r);
+    }
+    cb->s1_hi = hi;
+    cb->s1_lo = lo;
+}
+
+/* Master key (= state s_0) of candidate j */
+static inline void candidate_master(const CandidateBlock* cb, int j, uint64_t* mh, uint64_t* ml)
+{
+    uint64_t h = cb->s1_hi ^ g_ds1_hi[j], l = cb->s1_lo ^ g_ds1_lo[j];
+    undo_step(&h, &l, 1);
+    *mh = h;
+    *ml = l;
+}
+
+/* rk[w], w = 1..19, of candidate j */
+static inline uint64_t candidate_rk(const CandidateBlock* cb, int j, int w)
+{
+    return cb->rk[w] ^ g_drk[w][j];
+}
+
+/* Rounds first..last of encrypt() on the halves (h, l) of candidate j */
+static inline void candidate_rounds(const CandidateBlock* cb, int j,
+    uint32_t* h, uint32_t* l, int first, int last)
+{
+    uint32_t hh = *h, ll = *l;
+    for (int r = first; r <= last; ++r) {
+        uint32_t t = table_lookup32(hh ^ (uint32_t)candidate_rk(cb, j, r)) ^ ll;
+        ll = hh;
+        hh = t;
+    }
+    *h = hh;
+    *l = ll;
+}
+
+/* encrypt() with round keys formed on demand; K0 = rk[0] of the candidate */
+static inline uint64_t candidate_encrypt(const CandidateBlock* cb, int j, uint64_t K0, uint64_t pt)
+{
+    uint64_t s = pt ^ K0;
+    uint32_t h = (uint32_t)(s >> 32), l = (uint32_t)s;
+
+    candidate_rounds(cb, j, &h, &l, 1, 18);
+    return (((uint64_t)h << 32) | l) ^ candidate_rk(cb, j, 19);
+}
+
+/*-------------------------------------------------------------*/
+/*  Bitsliced candidate block                                  */
+/*-------------------------------------------------------------*/
+/*
+ * The 64 candidates of a block are the 64 lanes of the bitsliced engine.
+ * Plane b of rk[w], w ≥ 1, is the broadcast bit b of the block base's rk[w]
+ * XOR bit b of the difference table, so the whole schedule is XORs.  Only
+ * rk[0] needs the non‑linear step 1, and of s_0 it reads just h bits 0..57
+ * and l bits 58..63: the inverse S‑box therefore runs as a circuit on the
+ * low nibble of the top byte (h bits 56..59) for outputs 0 and 1 only.
+ */
+
+/* rk[0] planes: step 1 undone on s_1 planes, then K_0 = hi(rotr61(s_0)) */
+static void bs_candidate_k0(const CandidateBlock* cb, uint64_t k0[64])
+{
+    uint64_t h[60], l[64];
+    for (int b = 0; b < 60; ++b)
+        h[b] = BS_BIT(cb->s1_hi, b) ^ g_ds1_plane[1][b];
+    for (int b = 58; b < 64; ++b)
+        l[b] = BS_BIT(cb->s1_lo, b) ^ g_ds1_plane[0][b];
+
+    /* step 1's constant: (1 >> 2) & 3 = 0 into h, (1 & 3) << 62 into l */
+    l[62] = ~l[62];
+
+    /*
+     * inv4 = {3,7,C,9,A,D,F,0,6,8,E,5,B,4,1,2}, output bits 0 and 1:
+     *   y0 = 1 ^ x1 ^ x0x1 ^ x2 ^ x0x2 ^ x0x1x2 ^ x3 ^ x1x3
+     *   y1 = 1 ^ x1 ^ x0x2 ^ x1x2 ^ x0x3 ^ x1x3 ^ x0x2x3
+     */
+    uint64_t x0 = h[56], x1 = h[57], x2 = h[58], x3 = h[59];
+    uint64_t a01 = x0 & x1, a02 = x0 & x2, a13 = x1 & x3;
+    h[56] = ~(x1 ^ a01 ^ x2 ^ a02 ^ (a01 & x2) ^ x3 ^ a13);
+    h[57] = ~(x1 ^ a02 ^ (x1 & x2) ^ (x0 & x3) ^ a13 ^ (a02 & x3));
+
+    /* s_0 = rotl67(h:l), so K_0 bit b is l bit 58 + b (b < 6) or h bit b − 6 */
+    for (int b = 0; b < 6; ++b)
+        k0[b] = l[58 + b];
+    for (int b = 6; b < 64; ++b)
+        k0[b] = h[b - 6];
+}
+
+/* Planes of rk[first..last] of the block's 64 candidates (rk[0] as above) */
+static void bs_candidate_keys(const CandidateBlock* cb, BitslicedKeySchedule* bks, int first, int last)
+{
+    for (int w = first; w <= last; ++w) {
+        if (w == 0) {
+            bs_candidate_k0(cb, bks->plane[0]);
+            continue;
+        }
+        int bytes = (w == 19) ? 8 : 4;    /* rk[1..18] use planes 0..31 only */
+        for (int q = 0; q < bytes; ++q) {
+            const uint64_t* bit = g_bit_planes[(cb->rk[w] >> (8 * q)) & 0xFF];
+            for (int b = 0; b < 8; ++b)
+                bks->plane[w][8 * q + b] = bit[b] ^ g_drk_plane[w][8 * q + b];
+        }
+    }
+}
+
+/* Compare the generator, scalar and bitsliced, with unpermute_key() + key_schedule() */
+static int candidate_self_test(void)
+{
+    BitslicedKeySchedule bks;
+    uint64_t x = 0x5DEECE66DULL, ct[CAND_BLOCK];
+    for (int t = 0; t < 64; ++t) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        uint64_t hi = x & ~(0x3FULL << 32);
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        uint64_t lo = x & ~(0x3FULL << 29);
+
+        CandidateBlock cb;
+        candidate_block_init(&cb, hi, lo);
+        bs_candidate_keys(&cb, &bks, 0, 19);
+        bs_encrypt_keys(x, &bks, ct);
+        for (int j = 0; j < CAND_BLOCK; ++j) {
+            uint64_t rh, rl, mh, ml;
+            unpermute_key(hi ^ ((uint64_t)j << 32), lo ^ ((uint64_t)j << 29), &rh, &rl);
+            candidate_master(&cb, j, &mh, &ml);
+            if (mh != rh || ml != rl) return 0;
+
+            uint8_t mk[16];
+            for (int i = 0; i < 8; ++i) mk[i] = (uint8_t)(mh >> (56 - 8 * i));
+            for (int i = 0; i < 8; ++i) mk[8 + i] = (uint8_t)(ml >> (56 - 8 * i));
+            KeySchedule ks;
+            key_schedule(mk, &ks);
+            if (round_key_of(mh, ml) != ks.rk[0]) return 0;
+            for (int w = 1; w < 20; ++w)
+                if (candidate_rk(&cb, j, w) != ks.rk[w]) return 0;
+
+            uint64_t ref;
+            encrypt(x, &ks, &ref);
+            if (ct[j] != ref) return 0;
+        }
+    }
+    return 1;
+}
+
 /*-------------------------------------------------------------*/
 /*  Search context (TLS‑friendly globals)                      */
 /*-------------------------------------------------------------*/
@@ -90,13 +333,72 @@ static uint32_t  g_RK16, g_RK17, g_RK18;
 static volatile int g_found = 0;
 static uint8_t   g_found_key[16];
 
+/*-------------------------------------------------------------*/
+/*  Meet‑in‑the‑middle filter on pair 0                        */
+/*-------------------------------------------------------------*/
+/*
+ * Rounds 16..18 use rk16/rk17/rk18, and the search already knows them up
+ * to the whitening key K10 = rk[19].  K10_R is fixed by the template, so
+ * pair 0's ciphertext can be peeled back through those three rounds once
+ * per template, leaving (H/L = high/low half after round r)
+ *
+ *     H15 = C_L ^ K10_R ^ F(A ^ RK17)          fixed per template
+ *     L15 = A ^ F(H15 ^ RK16 ^ K10_R) ^ K10_L  = B ^ K10_L
+ *     with A = C_H ^ F(C_L ^ RK18).
+ *
+ * L15 = H14, so a candidate is first checked on a 32‑bit slice after
+ * 14 forward rounds, then on H15 after round 15.  Only the survivors of
+ * both stages get the full two‑pair encryption.  Moving the meet point
+ * further back would need candidate‑specific keys (rk15 and before), so
+ * every extra backward round costs exactly the forward round it saves.
+ */
+#define MEET_ROUND  14
+
+typedef struct {
+    uint32_t h15;   /* H15 of pair 0                 */
+    uint32_t b;     /* L15 = H14 = b ^ K10_L         */
+} MeetTarget;
+
+enum {
+    STAGE_TESTED,     /* candidates entering the filter      */
+    STAGE_SLICE14,    /* passed the 32‑bit slice at round 14 */
+    STAGE_SLICE15,    /* passed the H15 check at round 15    */
+    STAGE_FULL,       /* encrypted both pairs correctly      */
+    STAGE_COUNT
+};
+static uint64_t g_stage_cnt[STAGE_COUNT];
+
+static void meet_target_init(MeetTarget* mt, uint32_t K10_R)
+{
+    uint32_t C_H = (uint32_t)(g_pairs[0].ciphertext >> 32);
+    uint32_t C_L = (uint32_t)g_pairs[0].ciphertext;
+
+    uint32_t A = C_H ^ table_lookup32(C_L ^ g_RK18);
+    mt->h15 = C_L ^ K10_R ^ table_lookup32(A ^ g_RK17);
+    mt->b = A ^ table_lookup32(mt->h15 ^ g_RK16 ^ K10_R);
+}
+
+static void report_stage_counters(void)
+{
+    static const char* name[STAGE_COUNT] = {
+        "tested", "round-14 slice", "round-15 slice", "both pairs"
+    };
+    printf("[MITM] %-15s %llu\n", name[0], (unsigned long long)g_stage_cnt[0]);
+    for (int s = 1; s < STAGE_COUNT; ++s) {
+        uint64_t in = g_stage_cnt[s - 1], out = g_stage_cnt[s];
+        double rej = in ? 100.0 * (double)(in - out) / (double)in : 0.0;
+        printf("[MITM] %-15s %llu passed, %.6f%% rejected\n",
+            name[s], (unsigned long long)out, rej);
+    }
+}
+
 /*-------------------------------------------------------------*/
 /*  Candidate verification                                     */
 /*-------------------------------------------------------------*/
-static int verify_master_key(uint64_t hi, uint64_t lo)
+/* Checks a candidate with the reference code; on success mk holds the key */
+static int verify_master_key(uint64_t hi, uint64_t lo, uint8_t mk[16])
 {
     /* build 128‑bit key in big‑endian order */
-    uint8_t mk[16];
     for (int i = 0; i < 8; ++i) mk[i] = (uint8_t)(hi >> (56 - 8 * i));
     for (int i = 0; i < 8; ++i) mk[8 + i] = (uint8_t)(lo >> (56 - 8 * i));
 
@@ -110,10 +412,61 @@ static int verify_master_key(uint64_t hi, uint64_t lo)
     encrypt(g_pairs[1].plaintext, &ks, &ct);
     if (ct != g_pairs[1].ciphertext) return 0;
 
-    memcpy(g_found_key, mk, 16);
     return 1;
 }
 
+/*
+ * Fast path: the staged pair‑0 filter on all 64 candidates of a block at
+ * once, one lane each.  A stage ends the block as soon as no lane is left,
+ * so the keys of rounds 15..18 are only formed when something survives
+ * round 14.  Returns the lanes that encrypt pair 0 correctly.
+ */
+static uint64_t verify_block(const CandidateBlock* cb, BitslicedKeySchedule* bks,
+    const MeetTarget* mt, uint64_t cnt[STAGE_COUNT])
+{
+    uint64_t s[64], m = ~0ULL;
+    uint64_t pt = g_pairs[0].plaintext, ct = g_pairs[0].ciphertext;
+    cnt[STAGE_TESTED] += CAND_BLOCK;
+
+    bs_candidate_keys(cb, bks, 0, MEET_ROUND);
+    bs_candidate_keys(cb, bks, 19, 19);
+    for (int b = 0; b < 64; ++b)
+        s[b] = BS_BIT(pt, b) ^ bks->plane[0][b];
+
+    bs_encrypt_rounds(s, bks, 1, MEET_ROUND);
+    for (int b = 0; b < 32 && m; ++b)
+        m &= ~(s[32 + b] ^ BS_BIT(mt->b, b) ^ bks->plane[19][32 + b]);
+    if (!m) return 0;
+    cnt[STAGE_SLICE14] += (uint64_t)bs_popcount64(m);
+
+    bs_candidate_keys(cb, bks, MEET_ROUND + 1, 18);
+    bs_encrypt_rounds(s, bks, MEET_ROUND + 1, MEET_ROUND + 1);
+    for (int b = 0; b < 32 && m; ++b)
+        m &= ~(s[32 + b] ^ BS_BIT(mt->h15, b));
+    if (!m) return 0;
+    cnt[STAGE_SLICE15] += (uint64_t)bs_popcount64(m);
+
+    bs_encrypt_rounds(s, bks, MEET_ROUND + 2, 18);
+    for (int b = 0; b < 64 && m; ++b)
+        m &= ~(s[b] ^ bks->plane[19][b] ^ BS_BIT(ct, b));
+    return m;
+}
+
+/* A lane that passed verify_block(): pair 1 through the incremental schedule */
+static int verify_candidate(const CandidateBlock* cb, int j, uint64_t cnt[STAGE_COUNT], uint8_t mk[16])
+{
+    uint64_t mh, ml;
+    candidate_master(cb, j, &mh, &ml);
+
+    uint64_t K0 = round_key_of(mh, ml);
+    if (candidate_encrypt(cb, j, K0, g_pairs[1].plaintext) != g_pairs[1].ciphertext) return 0;
+
+    ++cnt[STAGE_FULL];
+
+    /* confirm with the reference key_schedule()/encrypt() */
+    return verify_master_key(mh, ml, mk);
+}
+
 /*-------------------------------------------------------------*/
 /*  Core enumeration (one of 64 outer templates)               */
 /*-------------------------------------------------------------*/
@@ -195,31 +548,42 @@ static void search_one(
 #undef SET_H
 #undef SET_L
 
-    /*=========== inner 2^29 loop =============================*/
+    /*=========== pair‑0 peel, shared by the whole template ==*/
+    MeetTarget mt;
+    meet_target_init(&mt, (uint32_t)tmpl_hi);
+
+    /*=========== inner 2^29 loop, 64 candidates per block ====*/
 #pragma omp parallel
     {
-        uint64_t local_cnt = 0;
-        int32_t i = 0;
+        CandidateBlock cb;
+        BitslicedKeySchedule bks;
+        uint64_t cnt[STAGE_COUNT] = { 0 };
+        int32_t blk = 0;
 #pragma omp for schedule(static)
-        for (i = 0; i < (1U << 29); ++i) {
+        for (blk = 0; blk < (1 << (29 - CAND_BLOCK_BITS)); ++blk) {
             if (g_found) continue;
 
-            uint64_t hi = tmpl_hi | ((uint64_t)(i ^ (RK17 & 0x1FFFFFFF)) << 32);
-            uint64_t lo = tmpl_lo | ((uint64_t)i << 29);
-
-            uint64_t rh, rl;
-            unpermute_key(hi, lo, &rh, &rl);
+            uint32_t i0 = (uint32_t)blk << CAND_BLOCK_BITS;
+            uint64_t hi = tmpl_hi | ((uint64_t)(i0 ^ (RK17 & 0x1FFFFFFF)) << 32);
+            uint64_t lo = tmpl_lo | ((uint64_t)i0 << 29);
+            candidate_block_init(&cb, hi, lo);
 
-            if (verify_master_key(rh, rl)) {
+            uint64_t m = verify_block(&cb, &bks, &mt, cnt);
+            for (int j = 0; m; ++j, m >>= 1) {
+                uint8_t mk[16];
+                if ((m & 1) && verify_candidate(&cb, j, cnt, mk)) {
 #pragma omp critical
-                {
-                    g_found = 1;
+                    {
+                        memcpy(g_found_key, mk, 16);
+                        g_found = 1;
+                    }
                 }
             }
+        }
 
-            if (++local_cnt == (1ULL << 20)) {
-                local_cnt = 0; /* simple dividend to throttle */
-            }
+        for (int st = 0; st < STAGE_COUNT; ++st) {
+#pragma omp atomic
+            g_stage_cnt[st] += cnt[st];
         }
     }
 }
@@ -238,10 +602,23 @@ int find_master_key(
     memcpy(g_pairs, pairs, sizeof(Pair) * 2);
     g_RK16 = rk16; g_RK17 = rk17; g_RK18 = rk18;
     g_found = 0;
+    memset(g_stage_cnt, 0, sizeof(g_stage_cnt));
+
+    /* the tables depend on nothing above: build and check them once */
+    static int tables = 0;   /* 0: not built, 1: verified, ‑1: self test failed */
+    if (!tables) {
+        candidate_tables_init();
+        tables = candidate_self_test() ? 1 : -1;
+    }
+    if (tables < 0) {
+        puts("[!] incremental key schedule disagrees with key_schedule()");
+        return 0;
+    }
 
     /* 64 outer templates */
     for (uint8_t in = 0; in < 64 && !g_found; ++in)
         search_one(in, rk16, rk17, rk18);
+    report_stage_counters();
 
     if (!g_found) return 0;
     memcpy(master_key_out, g_found_key, 16);